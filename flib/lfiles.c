@@ -18,15 +18,6 @@
 #include "../shared/lconsts.h"
 #include "../shared/shared.h"
 
-const char *FILE_TYPES[] = {
-    "T_DIR", "T_TEXT", "T_BINARY", "T_IMAGE", "T_JSON", "T_AUDIO", "T_FILM",
-    "T_COMPRESSED", "T_YAML", "T_EXE", "T_C", "T_PYTHON", "T_JS",
-    "T_JAVA", "T_LOG", "T_PACKAGE", "T_CLASS", "T_TEMPLATE", "T_PHP", "T_MATHEMATICA",
-    "T_PDF", "T_JAR", "T_HTML", "T_XML", "T_XHTML", "T_MATLAB", "T_FORTRAN", "T_SCIENCE", "T_CPP",
-    "T_TS", "T_DOC", "T_CALC", "T_LATEX", "T_SQL", "T_PRESENTATION", "T_DATA", "T_LIBRARY", "T_OBJECT",
-    "T_CSV", "T_CSS", "T_LINK_DIR", "T_LINK_FILE"
-};
-
 // Check if the file has the .json extension (case insensitive)
 int isJsonFile(const char *filePath) {
     const char *dot = strrchr(filePath, '.');
@@ -270,97 +261,97 @@ int isObjectFile(const char *filePath) {
            dot && strcasecmp(dot, ".mex") == 0 || dot && strcasecmp(dot, ".aout") == 0;
 }
 
-const char *getFileTypeCategory(const char *mimeType, const char *filePath) {
+FileType getFileTypeCategory(const char *mimeType, const char *filePath) {
     struct stat pathStat;
     if (stat(filePath, &pathStat) == 0 && S_ISDIR(pathStat.st_mode)) {
-        return "T_DIR"; // Add classification for directories
+        return T_DIR; // Add classification for directories
     }
     if (strstr(mimeType, "text/") == mimeType) {
         if (isJsonFile(filePath)) {
-            return "T_JSON";
+            return T_JSON;
         }
         if (isYamlFile(filePath)) {
-            return "T_YAML";
+            return T_YAML;
         }
         if (isCFile(filePath)) {
-            return "T_C";
+            return T_C;
         }
         if (isCppFile(filePath)) {
-            return "T_CPP";
+            return T_CPP;
         }
         if (isPythonFile(filePath)) {
-            return "T_PYTHON";
+            return T_PYTHON;
         }
         if (isJavaFile(filePath)) {
-            return "T_JAVA";
+            return T_JAVA;
         }
         if (isCompressedFile(filePath)) {
-            return "T_COMPRESSED";
+            return T_COMPRESSED;
         }
         if (isLogFile(filePath)) {
-            return "T_LOG";
+            return T_LOG;
         }
         if (isTemplateFile(filePath)) {
-            return "T_TEMPLATE";
+            return T_TEMPLATE;
         }
         if (isHtmlFile(filePath)) {
-            return "T_HTML";
+            return T_HTML;
         }
         if (isXmlFile(filePath)) {
-            return "T_XML";
+            return T_XML;
         }
         if (isXhtmlFile(filePath)) {
-            return "T_XHTML";
+            return T_XHTML;
         }
         if (isTsFile(filePath)) {
-            return "T_TS";
+            return T_TS;
         }
         if (isJsFile(filePath)) {
-            return "T_JS";
+            return T_JS;
         }
         if (isDocFile(filePath)) {
-            return "T_DOC";
+            return T_DOC;
         }
         if (isTexFile(filePath)) {
-            return "T_LATEX";
+            return T_LATEX;
         }
         if (isSqlFile(filePath)) {
-            return "T_SQL";
+            return T_SQL;
         }
         if (isCssFile(filePath)) {
-            return "T_CSS";
+            return T_CSS;
         }
         if (isCsvFile(filePath)) {
-            return "T_CSV";
+            return T_CSV;
         }
         if (isScienceFile(filePath)) {
-            return "T_SCIENCE";
+            return T_SCIENCE;
         }
         if (isFortranFile(filePath)) {
-            return "T_FORTRAN";
+            return T_FORTRAN;
         }
         if (isMathematicaFile(filePath)) {
-            return "T_MATHEMATICA";
+            return T_MATHEMATICA;
         }
         if (isMatlabFile(filePath)) {
-            return "T_MATLAB";
+            return T_MATLAB;
         }
         if (isPhpFile(filePath)) {
-            return "T_PHP";
+            return T_PHP;
         }
         if (isDataFile(filePath)) {
-            return "T_DATA";
+            return T_DATA;
         }
-        return "T_TEXT";
+        return T_TEXT;
     }
     if (strstr(mimeType, "image/") == mimeType || isImageFile(filePath)) {
-        return "T_IMAGE";
+        return T_IMAGE;
     }
     if (strstr(mimeType, "video/") == mimeType || isFilmFile(filePath)) {
-        return "T_FILM";
+        return T_FILM;
     }
     if (strstr(mimeType, "audio/") == mimeType || isAudioFile(filePath)) {
-        return "T_AUDIO";
+        return T_AUDIO;
     }
     if (strstr(mimeType, "application/zip") == mimeType ||
         strstr(mimeType, "application/x-tar") == mimeType ||
@@ -369,63 +360,63 @@ const char *getFileTypeCategory(const char *mimeType, const char *filePath) {
         strstr(mimeType, "application/x-7z-compressed") == mimeType ||
         strstr(mimeType, "application/x-rar-compressed") == mimeType) {
         if (isJarFile(filePath)) {
-            return "T_JAR";
+            return T_JAR;
         }
-        return "T_COMPRESSED";
+        return T_COMPRESSED;
     }
     if (isExeFile(filePath)) {
-        return "T_EXE";
+        return T_EXE;
     }
     if (isPackageFile(filePath)) {
-        return "T_PACKAGE";
+        return T_PACKAGE;
     }
     if (isClassFile(filePath)) {
-        return "T_CLASS";
+        return T_CLASS;
     }
     if (isPdfFile(filePath)) {
-        return "T_PDF";
+        return T_PDF;
     }
     if (isJarFile(filePath)) {
-        return "T_JAR";
+        return T_JAR;
     }
     if (isCalcFile(filePath)) {
-        return "T_CALC";
+        return T_CALC;
     }
     if (isJsonFile(filePath)) {
-        return "T_JSON";
+        return T_JSON;
     }
     if (isDataFile(filePath)) {
-        return "T_DATA";
+        return T_DATA;
     }
     if (isPresentationFile(filePath)) {
-        return "T_PRESENTATION";
+        return T_PRESENTATION;
     }
     if (isMathematicaFile(filePath)) {
-        return "T_MATHEMATICA";
+        return T_MATHEMATICA;
     }
     if (isMatlabFile(filePath)) {
-        return "T_MATLAB";
+        return T_MATLAB;
     }
     if (isScienceFile(filePath)) {
-        return "T_SCIENCE";
+        return T_SCIENCE;
     }
     if (isObjectFile(filePath)) {
-        return "T_OBJECT";
+        return T_OBJECT;
     }
     if (isLibFile(filePath)) {
-        return "T_LIBRARY";
+        return T_LIBRARY;
     }
     if (isFortranFile(filePath)) {
-        return "T_FORTRAN";
+        return T_FORTRAN;
     }
     if (isPhpFile(filePath)) {
-        return "T_PHP";
+        return T_PHP;
     }
     if (isCppFile(filePath)) {
-        return "T_PHP";
+        return T_PHP;
     }
 
-    return "T_BINARY";
+    return T_BINARY;
 }
 
 char *getFileName(const char *path) {
@@ -656,7 +647,7 @@ void processDirectory(TaskQueue *taskQueue, FileEntry **entries, int *count, int
                 (*entries)[current].isLink = 1;
                 snprintf((*entries)[current].linkTarget, sizeof((*entries)[current].linkTarget), "%s", target_path);
                 (*entries)[current].childrenCount = childrenCount; // Store the children count
-                snprintf((*entries)[current].type, sizeof((*entries)[current].type), "T_LINK_DIR");
+                (*entries)[current].type = T_LINK_DIR;
             } else if (S_ISDIR(fileStatCurrentPath.st_mode)) {
                 (*count)++;
                 snprintf((*entries)[current].path, sizeof((*entries)[current].path), "%s", currentPath);
@@ -664,7 +655,7 @@ void processDirectory(TaskQueue *taskQueue, FileEntry **entries, int *count, int
                 (*entries)[current].isDir = 1; // Mark as a directory
                 (*entries)[current].isLink = 0;
                 (*entries)[current].childrenCount = childrenCount; // Store the children count
-                snprintf((*entries)[current].type, sizeof((*entries)[current].type), "T_DIR");
+                (*entries)[current].type = T_DIR;
             }
         }
 
@@ -715,12 +706,10 @@ void processDirectory(TaskQueue *taskQueue, FileEntry **entries, int *count, int
                                     (*entries)[current].isDir = 0; // Mark as a file
                                     (*entries)[current].isLink = 0;
                                     (*entries)[current].childrenCount = 0; // Files don't have children
-                                    snprintf((*entries)[current].type, sizeof((*entries)[current].type), "%s",
-                                             getFileTypeCategory(mimeType, fullPath));
+                                    (*entries)[current].type = getFileTypeCategory(mimeType, fullPath);
 
                                     if (S_ISLNK(fileStat.st_mode)) {
-                                        snprintf((*entries)[current].type, sizeof((*entries)[current].type),
-                                                 "T_LINK_FILE");
+                                        (*entries)[current].type = T_LINK_FILE;
                                     }
                                 }
                             }
@@ -751,7 +740,7 @@ void processDirectory(TaskQueue *taskQueue, FileEntry **entries, int *count, int
                             (*entries)[current].isDir = 1; // Mark as a directory
                             (*entries)[current].isLink = 0;
                             (*entries)[current].childrenCount = 0; // Initialize children count (updated when processed)
-                            snprintf((*entries)[current].type, sizeof((*entries)[current].type), "T_DIR");
+                            (*entries)[current].type = T_DIR;
                         }
                         if (!skipDirs) {
                             // If directories need to be enqueued for further exploration
@@ -787,7 +776,7 @@ void initializeFileEntries(FileEntry *entries, const size_t count) {
         entries[i].isDir = 0; // Initialize isDir to false (0)
         entries[i].isHidden = 0; // Initialize isHidden to false (0)
         entries[i].childrenCount = 0; // Initialize childrenCount to 0
-        entries[i].type[0] = '\0'; // Initialize type to empty
+        entries[i].type = T_BINARY; // Initialize type to the catch-all
     }
 }
 
@@ -978,9 +967,12 @@ void read_entries(const char *filename, FileEntry **entries, const size_t fixed_
             fprintf(stderr, "Error parsing type in line: %s\n", buffer);
             continue;
         }
-        strncpy(entry.type, token, sizeof(entry.type) - 1);
-        entry.type[sizeof(entry.type) - 1] = '\0';
-        if (strcmp(entry.type, "T_LINK_FILE") == 0) {
+        entry.type = file_type_from_name(token, strlen(token));
+        if (entry.type == FILE_TYPE_INVALID) {
+            fprintf(stderr, "Unknown type in line: %s\n", buffer);
+            continue;
+        }
+        if (entry.type == T_LINK_FILE) {
             entry.isLink = true;
             token = strtok(NULL, SEP);
             if (strncmp(token, "L_TARGET", 9) == 0) {
@@ -994,10 +986,10 @@ void read_entries(const char *filename, FileEntry **entries, const size_t fixed_
             }
         }
         // Check if the entry is a directory and process extra flags
-        if (strcmp(entry.type, "T_DIR") == 0 || strcmp(entry.type, "T_LINK_DIR") == 0) {
-            if (strcmp(entry.type, "T_DIR") == 0) {
+        if (entry.type == T_DIR || entry.type == T_LINK_DIR) {
+            if (entry.type == T_DIR) {
                 entry.isDir = true;
-            } else if (strcmp(entry.type, "T_LINK_DIR") == 0) {
+            } else if (entry.type == T_LINK_DIR) {
                 entry.isLink = true;
             }
             // Look for additional flags (e.g., C_COUNT and F_HIDDEN)
@@ -1066,12 +1058,12 @@ void printToFile(FileEntry *entries, const int count, const char *filename, cons
         char *fileName = getFileName(entries[i].path);
         const int isHidden = (fileName[0] == '.'); // Check if the file is hidden
         free(fileName);
-        fprintf(outputFile, "%s%s%ld%s%s", entries[i].path, SEP, entries[i].size, SEP, entries[i].type);
+        fprintf(outputFile, "%s%s%ld%s%s", entries[i].path, SEP, entries[i].size, SEP, FILE_TYPES[entries[i].type]);
         // If the entry is a directory, add the count of children
-        if (entries[i].isDir || strcmp(entries[i].type, "T_LINK_DIR") == 0) {
+        if (entries[i].isDir || entries[i].type == T_LINK_DIR) {
             fprintf(outputFile, "%sC_COUNT%s%zu", SEP, SEP, entries[i].childrenCount);
         }
-        if (strcmp(entries[i].type, "T_LINK_DIR") == 0 || strcmp(entries[i].type, "T_LINK_FILE") == 0) {
+        if (entries[i].type == T_LINK_DIR || entries[i].type == T_LINK_FILE) {
             fprintf(outputFile, "%sL_TARGET%s%s", SEP, SEP, entries[i].linkTarget);
         }
         if (isHidden) {
@@ -1284,20 +1276,18 @@ void printToStdOut(FileEntry *entries, const int count) {
         const int isHidden = (fileName[0] == '.'); // Check if the file is hidden
         char *sizeStr = getFileSizeAsString(entries[i].size);
         printf("%s %s, Size: %s (%ld bytes), Type: %s",
-               (strcmp(entries[i].type, "T_DIR") == 0)
+               entries[i].type == T_DIR
                    ? "Dir:"
-                   : (strcmp(entries[i].type, "T_FILE") == 0)
-                         ? "File:"
-                         : (strcmp(entries[i].type, "T_LINK_DIR") == 0 || strcmp(entries[i].type, "T_LINK_FILE") == 0)
-                               ? "Link:"
-                               : "Unknown:",
-               entries[i].path, sizeStr, entries[i].size, entries[i].type);
+                   : entries[i].type == T_LINK_DIR || entries[i].type == T_LINK_FILE
+                         ? "Link:"
+                         : "File:",
+               entries[i].path, sizeStr, entries[i].size, FILE_TYPES[entries[i].type]);
 
         // If the entry is a directory, add the count of children
-        if (entries[i].isDir || strcmp(entries[i].type, "T_LINK_DIR") == 0) {
+        if (entries[i].isDir || entries[i].type == T_LINK_DIR) {
             printf(", C_COUNT: %zu", entries[i].childrenCount);
         }
-        if (strcmp(entries[i].type, "T_LINK_DIR") == 0 || strcmp(entries[i].type, "T_LINK_FILE") == 0) {
+        if (entries[i].type == T_LINK_DIR || entries[i].type == T_LINK_FILE) {
             printf(", L_TARGET: %s", entries[i].linkTarget);
         }
         if (isHidden) {
@@ -2103,7 +2093,7 @@ void compute_file_statistics(const FileEntry *entries, const int count, FileStat
             stats->totalFiles++;
         }
 
-        // File type counters using string comparison
+        // File type counters
         if (entry->isHidden && !entry->isDir && !entry->isLink) {
             stats->hiddenFiles++;
             stats->hiddenFilesSize += entry->size;
@@ -2111,131 +2101,161 @@ void compute_file_statistics(const FileEntry *entries, const int count, FileStat
             stats->hiddenDirs++;
             stats->hiddenDirsSize += entry->size;
         }
-        if (strcmp(entry->type, "T_TEXT") == 0) {
-            stats->textFiles++;
-            stats->textSize += entry->size;
-        } else if (strcmp(entry->type, "T_JSON") == 0) {
-            stats->jsonFiles++;
-            stats->jsonSize += entry->size;
-        } else if (strcmp(entry->type, "T_AUDIO") == 0) {
-            stats->musicFiles++;
-            stats->musicSize += entry->size;
-        } else if (strcmp(entry->type, "T_FILM") == 0) {
-            stats->filmFiles++;
-            stats->filmSize += entry->size;
-        } else if (strcmp(entry->type, "T_IMAGE") == 0) {
-            stats->imageFiles++;
-            stats->imageSize += entry->size;
-        } else if (strcmp(entry->type, "T_COMPRESSED") == 0) {
-            stats->compressedFiles++;
-            stats->compressedSize += entry->size;
-        } else if (strcmp(entry->type, "T_YAML") == 0) {
-            stats->yamlFiles++;
-            stats->yamlSize += entry->size;
-        } else if (strcmp(entry->type, "T_EXE") == 0) {
-            stats->exeFiles++;
-            stats->exeSize += entry->size;
-        } else if (strcmp(entry->type, "T_C") == 0) {
-            stats->cFiles++;
-            stats->cSize += entry->size;
-        } else if (strcmp(entry->type, "T_PYTHON") == 0) {
-            stats->pythonFiles++;
-            stats->pythonSize += entry->size;
-        } else if (strcmp(entry->type, "T_JAVA") == 0) {
-            stats->javaFiles++;
-            stats->javaSize += entry->size;
-        } else if (strcmp(entry->type, "T_LOG") == 0) {
-            stats->logFiles++;
-            stats->logSize += entry->size;
-        } else if (strcmp(entry->type, "T_PACKAGE") == 0) {
-            stats->packageFiles++;
-            stats->packageSize += entry->size;
-        } else if (strcmp(entry->type, "T_CLASS") == 0) {
-            stats->classFiles++;
-            stats->classSize += entry->size;
-        } else if (strcmp(entry->type, "T_TEMPLATE") == 0) {
-            stats->templateFiles++;
-            stats->templateSize += entry->size;
-        } else if (strcmp(entry->type, "T_PDF") == 0) {
-            stats->pdfFiles++;
-            stats->pdfSize += entry->size;
-        } else if (strcmp(entry->type, "T_HTML") == 0) {
-            stats->htmlFiles++;
-            stats->htmlSize += entry->size;
-        } else if (strcmp(entry->type, "T_XML") == 0) {
-            stats->xmlFiles++;
-            stats->xmlSize += entry->size;
-        } else if (strcmp(entry->type, "T_XHTML") == 0) {
-            stats->xhtmlFiles++;
-            stats->xhtmlSize += entry->size;
-        } else if (strcmp(entry->type, "T_TS") == 0) {
-            stats->tsFiles++;
-            stats->tsSize += entry->size;
-        } else if (strcmp(entry->type, "T_JAR") == 0) {
-            stats->jarFiles++;
-            stats->jarSize += entry->size;
-        } else if (strcmp(entry->type, "T_DOC") == 0) {
-            stats->docFiles++;
-            stats->docSize += entry->size;
-        } else if (strcmp(entry->type, "T_CALC") == 0) {
-            stats->calcFiles++;
-            stats->calcSize += entry->size;
-        } else if (strcmp(entry->type, "T_LATEX") == 0) {
-            stats->textFiles++;
-            stats->textSize += entry->size;
-        } else if (strcmp(entry->type, "T_SQL") == 0) {
-            stats->sqlFiles++;
-            stats->sqlSize += entry->size;
-        } else if (strcmp(entry->type, "T_CSV") == 0) {
-            stats->csvFiles++;
-            stats->csvSize += entry->size;
-        } else if (strcmp(entry->type, "T_CSS") == 0) {
-            stats->cssFiles++;
-            stats->cssSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_PHP") == 0) {
-            stats->phpFiles++;
-            stats->phpSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_MATHEMATICA") == 0) {
-            stats->mathematicaFiles++;
-            stats->mathematicaSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_MATLAB") == 0) {
-            stats->matlabFiles++;
-            stats->matlabSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_FORTRAN") == 0) {
-            stats->fortranFiles++;
-            stats->fortranSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_SCIENCE") == 0) {
-            stats->scienceFiles++;
-            stats->scienceSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_DATA") == 0) {
-            stats->dataFiles++;
-            stats->dataSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_PRESENTATION") == 0) {
-            stats->presentationFiles++;
-            stats->presentationSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_LIBRARY") == 0) {
-            stats->libFiles++;
-            stats->libSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_OBJECT") == 0) {
-            stats->objFiles++;
-            stats->objSize += entry->size;
-        }
-        else if (strcmp(entry->type, "T_CPP") == 0) {
-            stats->cppFiles++;
-            stats->cppSize += entry->size;
-        }
-        else if (!entry->isDir && !entry->isLink) {
-            stats->binaryFiles++;
-            stats->binarySize += entry->size;
+        switch (entry->type) {
+            case T_TEXT:
+                stats->textFiles++;
+                stats->textSize += entry->size;
+                break;
+            case T_JSON:
+                stats->jsonFiles++;
+                stats->jsonSize += entry->size;
+                break;
+            case T_AUDIO:
+                stats->musicFiles++;
+                stats->musicSize += entry->size;
+                break;
+            case T_FILM:
+                stats->filmFiles++;
+                stats->filmSize += entry->size;
+                break;
+            case T_IMAGE:
+                stats->imageFiles++;
+                stats->imageSize += entry->size;
+                break;
+            case T_COMPRESSED:
+                stats->compressedFiles++;
+                stats->compressedSize += entry->size;
+                break;
+            case T_YAML:
+                stats->yamlFiles++;
+                stats->yamlSize += entry->size;
+                break;
+            case T_EXE:
+                stats->exeFiles++;
+                stats->exeSize += entry->size;
+                break;
+            case T_C:
+                stats->cFiles++;
+                stats->cSize += entry->size;
+                break;
+            case T_PYTHON:
+                stats->pythonFiles++;
+                stats->pythonSize += entry->size;
+                break;
+            case T_JAVA:
+                stats->javaFiles++;
+                stats->javaSize += entry->size;
+                break;
+            case T_LOG:
+                stats->logFiles++;
+                stats->logSize += entry->size;
+                break;
+            case T_PACKAGE:
+                stats->packageFiles++;
+                stats->packageSize += entry->size;
+                break;
+            case T_CLASS:
+                stats->classFiles++;
+                stats->classSize += entry->size;
+                break;
+            case T_TEMPLATE:
+                stats->templateFiles++;
+                stats->templateSize += entry->size;
+                break;
+            case T_PDF:
+                stats->pdfFiles++;
+                stats->pdfSize += entry->size;
+                break;
+            case T_HTML:
+                stats->htmlFiles++;
+                stats->htmlSize += entry->size;
+                break;
+            case T_XML:
+                stats->xmlFiles++;
+                stats->xmlSize += entry->size;
+                break;
+            case T_XHTML:
+                stats->xhtmlFiles++;
+                stats->xhtmlSize += entry->size;
+                break;
+            case T_TS:
+                stats->tsFiles++;
+                stats->tsSize += entry->size;
+                break;
+            case T_JAR:
+                stats->jarFiles++;
+                stats->jarSize += entry->size;
+                break;
+            case T_DOC:
+                stats->docFiles++;
+                stats->docSize += entry->size;
+                break;
+            case T_CALC:
+                stats->calcFiles++;
+                stats->calcSize += entry->size;
+                break;
+            case T_LATEX:
+                stats->textFiles++;
+                stats->textSize += entry->size;
+                break;
+            case T_SQL:
+                stats->sqlFiles++;
+                stats->sqlSize += entry->size;
+                break;
+            case T_CSV:
+                stats->csvFiles++;
+                stats->csvSize += entry->size;
+                break;
+            case T_CSS:
+                stats->cssFiles++;
+                stats->cssSize += entry->size;
+                break;
+            case T_PHP:
+                stats->phpFiles++;
+                stats->phpSize += entry->size;
+                break;
+            case T_MATHEMATICA:
+                stats->mathematicaFiles++;
+                stats->mathematicaSize += entry->size;
+                break;
+            case T_MATLAB:
+                stats->matlabFiles++;
+                stats->matlabSize += entry->size;
+                break;
+            case T_FORTRAN:
+                stats->fortranFiles++;
+                stats->fortranSize += entry->size;
+                break;
+            case T_SCIENCE:
+                stats->scienceFiles++;
+                stats->scienceSize += entry->size;
+                break;
+            case T_DATA:
+                stats->dataFiles++;
+                stats->dataSize += entry->size;
+                break;
+            case T_PRESENTATION:
+                stats->presentationFiles++;
+                stats->presentationSize += entry->size;
+                break;
+            case T_LIBRARY:
+                stats->libFiles++;
+                stats->libSize += entry->size;
+                break;
+            case T_OBJECT:
+                stats->objFiles++;
+                stats->objSize += entry->size;
+                break;
+            case T_CPP:
+                stats->cppFiles++;
+                stats->cppSize += entry->size;
+                break;
+            default:
+                if (!entry->isDir && !entry->isLink) {
+                    stats->binaryFiles++;
+                    stats->binarySize += entry->size;
+                }
+                break;
         }
     }
     free_array(&unique_directories);
@@ -67,7 +67,7 @@ int isCsvFile(const char *filePath);
 int isCssFile(const char *filePath);
 
 // File type categorization
-const char *getFileTypeCategory(const char *mimeType, const char *filePath);
+FileType getFileTypeCategory(const char *mimeType, const char *filePath);
 
 // Filename extraction utility
 char *getFileName(const char *path);
@@ -3,10 +3,13 @@
 
 DEFINE_COMPARATOR_BY_FIELD(name, strcmp)
 DEFINE_COMPARATOR_BY_FIELD(path, strcmp)
-DEFINE_COMPARATOR_BY_FIELD(hash, strcmp)
 DEFINE_NUMERIC_COMPARATOR(size)
+DEFINE_NUMERIC_COMPARATOR(hash)
 
-#define USAGE_MSG "Usage: --name, --size, --path, --all, --hash <filename.lst>, or --list <filename.lst>\n"
+#define USAGE_MSG "Usage: --name, --size, --path, --all, --hash <filename.lst>, --list <filename.lst>, " \
+                  "or --apply <diff.lst> <index.rbt|index.rbt.mem>; add --save to write a .rbt file, " \
+                  "--eytzinger for static size and hash indexes, --hash-algorithm <xxh64|sha256> to pick " \
+                  "how names and sizes are hashed (xxh64 by default)\n"
 
 void print_usage_and_exit() {
     fprintf(stderr, "%s", USAGE_MSG);
@@ -30,25 +33,37 @@ void parse_arguments(const int argc, char *argv[], Config *config) {
     config->skipCheck = false;
     config->save = false; // Initialize the "save" field to false
     config->insert_fn = NULL;
+    config->compare_fn = NULL;
     config->prefix = NULL;
+    config->index = NULL;
+    config->eytzinger = false;
+    config->hashAlgorithm = HASH_ALGORITHM_DEFAULT;
 
     // Handle operation flags
     if (strcmp(argv[1], "--name") == 0) {
         config->prefix = "rbt_name_";
         config->insert_fn = insert_name;
+        config->compare_fn = compareByname;
     } else if (strcmp(argv[1], "--size") == 0) {
         config->prefix = "rbt_size_";
         config->insert_fn = insert_size;
+        config->compare_fn = compareBysize;
     } else if (strcmp(argv[1], "--path") == 0) {
         config->prefix = "rbt_path_";
         config->insert_fn = insert_path;
+        config->compare_fn = compareBypath;
     } else if (strcmp(argv[1], "--hash") == 0) {
         config->prefix = "rbt_hash_";
         config->insert_fn = insert_hash;
+        config->compare_fn = compareByhash;
     } else if (strcmp(argv[1], "--all") == 0) {
         config->all = true;
     } else if (strcmp(argv[1], "--load") == 0) {
         config->skipCheck = true;
+        config->prefix = ""; // Saved trees already carry their rbt_<key>_ prefix
+    } else if (strcmp(argv[1], "--apply") == 0 && argc == 4) {
+        config->skipCheck = true;
+        config->index = argv[3];
     } else if (strcmp(argv[1], "--list") == 0 && argc == 3) {
         listSharedMemoryEntities(argv[2]);
         exit(EXIT_SUCCESS);
@@ -60,8 +75,17 @@ void parse_arguments(const int argc, char *argv[], Config *config) {
     } else {
         print_usage_and_exit();
     }
-    if (argc == 4 && strcmp(argv[3], "--save") == 0) {
-        config->save = true;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--save") == 0) {
+            config->save = true;
+        } else if (strcmp(argv[i], "--eytzinger") == 0) {
+            config->eytzinger = true; // Static layout for read-only size and hash indexes
+        } else if (strcmp(argv[i], "--hash-algorithm") == 0 && i + 1 < argc) {
+            if (!parse_hash_algorithm(argv[++i], &config->hashAlgorithm)) {
+                fprintf(stderr, "Unknown hash algorithm: %s\n", argv[i]);
+                print_usage_and_exit();
+            }
+        }
     }
 }
 
@@ -98,6 +122,24 @@ void handle_input_file_checks(const char *filename) {
     free(rootDirectories);
 }
 
+/**
+ * Picks the comparator of an index from the key recorded in its header.
+ *
+ * @param index The .rbt file or shared memory object name.
+ * @return The comparator the index is ordered by.
+ */
+int (*comparator_for_index(const char *index))(const FileInfo *, const FileInfo *) {
+    switch (read_index_key(index)) {
+        case INDEX_KEY_NAME: return compareByname;
+        case INDEX_KEY_SIZE: return compareBysize;
+        case INDEX_KEY_PATH: return compareBypath;
+        case INDEX_KEY_HASH: return compareByhash;
+        default:
+            fprintf(stderr, "Error: Index %s does not record the key it is ordered by.\n", index);
+            exit(EXIT_FAILURE);
+    }
+}
+
 /**
  * Main entry point for the program.
  */
@@ -105,16 +147,20 @@ int main(const int argc, char *argv[]) {
     Config config;
     parse_arguments(argc, argv, &config);
 
-    if (config.filename) {
+    if (config.filename && !config.skipCheck) {
         handle_input_file_checks(config.filename);
     }
-    if (config.all) {
-        createRbt(argc, argv, insert_name, "rbt_name_", config);
-        createRbt(argc, argv, insert_size, "rbt_size_", config);
-        createRbt(argc, argv, insert_path, "rbt_path_", config);
-        createRbt(argc, argv, insert_hash, "rbt_hash_", config);
+    if (config.index) {
+        applyRbtDiff(config.filename, config.index, comparator_for_index(config.index));
+    } else if (config.all) {
+        // One parse of the listing, four trees built in parallel over the same records
+        int (*compareFuncs[])(const FileInfo *, const FileInfo *) = {
+            compareByname, compareBysize, compareBypath, compareByhash
+        };
+        const char *prefixes[] = {"rbt_name_", "rbt_size_", "rbt_path_", "rbt_hash_"};
+        createRbts(argc, argv, compareFuncs, prefixes, 4, config);
     } else {
-        createRbt(argc, argv, config.insert_fn, config.prefix, config);
+        createRbt(argc, argv, config.compare_fn, config.prefix, config);
     }
 
     return EXIT_SUCCESS;
@@ -13,7 +13,15 @@ DEFINE_COMPARATOR_BY_FIELD(name, strcmp)
 int main(const int argc, char *argv[]) {
     const char *prefix = "rbt_name_";
 
-    createRbt(argc, argv, insert_name, prefix);
+    const Config config = {
+        .prefix = prefix,
+        .insert_fn = insert_name,
+        .compare_fn = compareByname,
+        .filename = argc > 2 ? argv[2] : NULL,
+        .hashAlgorithm = HASH_ALGORITHM_DEFAULT,
+    };
+
+    createRbt(argc, argv, compareByname, prefix, config);
 
     return EXIT_SUCCESS;
 }
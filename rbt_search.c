@@ -12,6 +12,34 @@
 
 #include "rbtlib/rbtree.h"
 #include "rbtlib/search.h"
+#include "shared/shared.h"
+
+// One --size range: "X" is X and up, "X-" is up to X, "X-Y" is X to Y, all inclusive
+static void parse_size_range(const char *text, SizeRange *range) {
+    const char *dash = strchr(text, '-');
+    if (dash == NULL) {
+        range->lower = parse_size(text);
+        range->upper = SIZE_MAX;
+        return;
+    }
+    if (dash == text) {
+        fprintf(stderr, "Invalid range for --size: %s\n", text);
+        exit(EXIT_FAILURE);
+    }
+    char bound[256];
+    snprintf(bound, sizeof(bound), "%.*s", (int) (dash - text), text);
+    if (dash[1] == '\0') {
+        range->lower = 0;
+        range->upper = parse_size(bound);
+        return;
+    }
+    range->lower = parse_size(bound);
+    range->upper = parse_size(dash + 1);
+    if (range->lower > range->upper) {
+        fprintf(stderr, "Invalid size range: lower bound is larger than upper bound.\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
 void parse_arguments(const int argc, char *argv[], Arguments *args) {
     // Initialize all struct members to default values
@@ -20,24 +48,26 @@ void parse_arguments(const int argc, char *argv[], Arguments *args) {
     args->names = NULL;
     args->names_count = 0;
     args->hashes = NULL;
+    args->hash_values = NULL;
     args->hashes_count = 0;
     args->size = -1;
-    args->size_lower_bound = 0;
-    args->size_upper_bound = 0;
+    args->size_ranges = NULL;
+    args->size_ranges_count = 0;
+    args->size_filtered = false;
     args->paths = NULL;
     args->paths_count = 0;
-    args->types = NULL;
+    args->types_mask = 0;
     args->types_count = 0;
     args->hash = NULL;
-    const char *valid_types[] = {
-        "T_DIR", "T_TEXT", "T_BINARY", "T_IMAGE", "T_JSON", "T_AUDIO", "T_FILM",
-        "T_COMPRESSED", "T_YAML", "T_EXE", "T_C", "T_PYTHON", "T_JS",
-        "T_JAVA", "T_LOG", "T_PACKAGE", "T_CLASS", "T_TEMPLATE", "T_PHP", "T_MATHEMATICA",
-        "T_PDF", "T_JAR", "T_HTML", "T_XML", "T_XHTML", "T_MATLAB", "T_FORTRAN", "T_SCIENCE", "T_CPP",
-        "T_TS", "T_DOC", "T_CALC", "T_LATEX", "T_SQL", "T_PRESENTATION", "T_DATA", "T_LIBRARY", "T_OBJECT",
-        "T_CSV", "T_CSS", "T_LINK_DIR", "T_LINK_FILE", "T_FILE",
-        NULL // Sentinel value to signal the end of the array
-    };
+    args->hash_value = 0;
+    args->hash_name = NULL;
+    args->hash_size = 0;
+    args->count = false;
+    args->sum = false;
+    args->verify = false;
+    args->rank = -1;
+    args->select = 0;
+    args->percentile = -1;
     if (argc == 1) {
         printf("No arguments provided.\n\n");
         print_help();
@@ -53,6 +83,38 @@ void parse_arguments(const int argc, char *argv[], Arguments *args) {
         else if (!strcmp(argv[i], "--duplicates")) {
             args->duplicates = true;
         }
+        else if (!strcmp(argv[i], "--count")) {
+            args->count = true;
+        }
+        else if (!strcmp(argv[i], "--sum")) {
+            args->sum = true;
+        }
+        else if (!strcmp(argv[i], "--verify")) {
+            args->verify = true;
+        }
+        else if (!strcmp(argv[i], "--rank") && i + 1 < argc) {
+            args->rank = parse_size(argv[++i]);
+            if (args->rank < 0) {
+                fprintf(stderr, "Invalid value for --rank: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[i], "--select") && i + 1 < argc) {
+            char *endptr = NULL;
+            args->select = strtoull(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || args->select == 0) {
+                fprintf(stderr, "Invalid value for --select (positions start at 1): %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[i], "--percentile") && i + 1 < argc) {
+            char *endptr = NULL;
+            args->percentile = strtod(argv[++i], &endptr);
+            if (*endptr != '\0' || args->percentile < 0 || args->percentile > 100) {
+                fprintf(stderr, "Invalid value for --percentile (0-100): %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
         else if (!strcmp(argv[i], "-n")) {
             // Handle multiple names
             i++;
@@ -82,51 +144,20 @@ void parse_arguments(const int argc, char *argv[], Arguments *args) {
                 exit(EXIT_FAILURE);
             }
             args->size = (int)value; // Safely assign to integer (after validation)
-            char size_str[20];
-            size_to_string(args->size, size_str, sizeof(size_str));
-            args->size_str = malloc(strlen(size_str) + 1); // Allocate memory for size_str
-            if (args->size_str == NULL) {
-                perror("Failed to allocate memory");
-                exit(EXIT_FAILURE);
-            }
-            strcpy(args->size_str, size_str);
         }
         else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
-            const char *size_arg = argv[++i];
-            if (strchr(size_arg, '-')) {
-                // Handle lower-bound size (e.g., "100k-", "10M-")
-                if (size_arg[strlen(size_arg) - 1] == '-') {
-                    char size_str[256];
-                    strncpy(size_str, size_arg, strlen(size_arg) - 1);
-                    size_str[strlen(size_arg) - 1] = '\0'; // Remove trailing '-'
-                    args->size_upper_bound = parse_size(size_str);
-                }
-                // Handle size ranges (e.g., "10M-100M")
-                else {
-                    char *dash = strchr(size_arg, '-');
-                    if (!dash || dash == size_arg || dash == size_arg + strlen(size_arg) - 1) {
-                        fprintf(stderr, "Invalid range for --size: %s\n", size_arg);
-                        exit(EXIT_FAILURE);
-                    }
-                    // Extract lower and upper bounds
-                    char lower_str[256], upper_str[256];
-                    strncpy(lower_str, size_arg, dash - size_arg);
-                    lower_str[dash - size_arg] = '\0';
-                    strcpy(upper_str, dash + 1);
-
-                    args->size_lower_bound = parse_size(lower_str);
-                    args->size_upper_bound = parse_size(upper_str);
-
-                    // Validate sizes
-                    if (args->size_lower_bound > args->size_upper_bound) {
-                        fprintf(stderr, "Invalid size range: lower bound is larger than upper bound.\n");
-                        exit(EXIT_FAILURE);
-                    }
+            // One range or several separated by commas, e.g. "1k-4k,1G"
+            char *list = strdup(argv[++i]);
+            char *saveptr = NULL;
+            for (char *range = strtok_r(list, ",", &saveptr); range; range = strtok_r(NULL, ",", &saveptr)) {
+                args->size_ranges = realloc(args->size_ranges, (args->size_ranges_count + 1) * sizeof(SizeRange));
+                if (args->size_ranges == NULL) {
+                    perror("Failed to allocate memory for size ranges");
+                    exit(EXIT_FAILURE);
                 }
-            } else {
-                // Handle upper-bound size (e.g., "100k", "10M", "1G")
-                args->size_lower_bound = parse_size(size_arg);
+                parse_size_range(range, &args->size_ranges[args->size_ranges_count++]);
             }
+            free(list);
         }
         else if (!strcmp(argv[i], "-p")) {
             // Handle multiple paths
@@ -160,36 +191,36 @@ void parse_arguments(const int argc, char *argv[], Arguments *args) {
         }
         else if (!strcmp(argv[i], "-t")) { // If -t is encountered
             i++;
-            // Allocate space for storing types (assuming no more than `argc - i` types)
-            args->types = malloc((argc - i) * sizeof(char *));
-            if (args->types == NULL) {
-                fprintf(stderr, "Memory allocation failed for types.\n");
-                exit(EXIT_FAILURE);
-            }
             // Collect multiple types until another flag is reached or end of arguments
             while (i < argc && argv[i][0] != '-') {
+                const FileType type = file_type_from_name(argv[i], strlen(argv[i]));
                 // Check if the current type is valid
-                if (!is_valid_type(argv[i], valid_types)) {
+                if (type == FILE_TYPE_INVALID && strcmp(argv[i], "T_FILE") != 0) {
                     fprintf(stderr, "Invalid type specified: %s\n", argv[i]);
                     fprintf(stderr, "Allowed types are:\n");
                     // Display valid types in a formatted way
-                    for (int j = 0; valid_types[j] != NULL; j++) {
+                    for (int j = 0; j < FILE_TYPES_COUNT; j++) {
                         if (j > 0 && j % 10 == 0) { // Format into multiple lines for readability
                             fprintf(stderr, "\n                 ");
                         }
-                        fprintf(stderr, "%s", valid_types[j]);
-                        if (valid_types[j + 1] != NULL) { // Add commas except for the last item
-                            fprintf(stderr, ", ");
-                        }
+                        fprintf(stderr, "%s, ", FILE_TYPES[j]);
                     }
-                    fprintf(stderr, "\n");
+                    fprintf(stderr, "T_FILE\n");
                     exit(EXIT_FAILURE); // Exit on invalid type
                 }
-                // Add the valid type to the types array
-                args->types[args->types_count] = argv[i];
+                if (type == FILE_TYPE_INVALID) {
+                    // T_FILE is not a stored type: it selects everything but directories
+                    args->types_mask |= ((UINT64_C(1) << FILE_TYPES_COUNT) - 1) & ~(UINT64_C(1) << T_DIR);
+                } else {
+                    args->types_mask |= UINT64_C(1) << type;
+                }
                 args->types_count++;
                 i++;
             }
+            if (args->types_count == 0) {
+                fprintf(stderr, "Error: No type provided after -t.\n");
+                exit(EXIT_FAILURE);
+            }
             i--; // Step back to correctly process the next argument
         }
         else if (!strcmp(argv[i], "-h") && i + 2 < argc) {
@@ -201,37 +232,25 @@ void parse_arguments(const int argc, char *argv[], Arguments *args) {
                 fprintf(stderr, "Invalid filesize value after -h: %s\n", argv[i]);
                 exit(EXIT_FAILURE);
             }
-            FileInfo file_info = {0};
-            file_info.size = filesize;
-            strncpy(file_info.name, filename, sizeof(file_info.name) - 1);
-            file_info.name[sizeof(file_info.name) - 1] = '\0'; // Null-terminate the string
-            EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-            if (ctx == NULL) {
-                fprintf(stderr, "Error: Unable to create hashing context\n");
-                exit(EXIT_FAILURE);
-            }
-            compute_and_store_hash(&file_info, ctx);
-            const size_t length = strlen(file_info.hash);
-            args->hash = (char *)malloc(length + 1); // +1 for null terminator
-            if (args->hash == NULL) {
-                perror("Failed to allocate memory for args->hash");
-               exit(EXIT_FAILURE);
-            }
-            memcpy(args->hash, file_info.hash, length);
-            args->hash[length] = '\0';
-            EVP_MD_CTX_free(ctx);
+            args->hash_name = filename;
+            args->hash_size = filesize;
         }
         else if (!strcmp(argv[i], "--h")) {
             // Handle multiple hashes
             i++;
             // Allocate memory for hashes array (initially NULL)
             args->hashes = malloc((argc - i) * sizeof(char *));
-            if (args->hashes == NULL) {
+            args->hash_values = malloc((argc - i) * sizeof(uint64_t));
+            if (args->hashes == NULL || args->hash_values == NULL) {
                 fprintf(stderr, "Memory allocation failed for hashes.\n");
                 exit(EXIT_FAILURE);
             }
 
             while (i < argc && argv[i][0] != '-') {
+                if (!hex_to_hash(argv[i], &args->hash_values[args->hashes_count])) {
+                    fprintf(stderr, "Invalid hash after --h, expected up to 16 hex digits: %s\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
                 args->hashes[args->hashes_count] = argv[i];
                 args->hashes_count++;
                 i++;
@@ -248,14 +267,34 @@ void parse_arguments(const int argc, char *argv[], Arguments *args) {
         fprintf(stderr, "Error: -f <memory_filename> is mandatory.\n");
         exit(EXIT_FAILURE);
     }
+    normalize_size_ranges(args);
+}
+
+// Hash the -h file name and size into arguments->hash
+static void hash_file_name_and_size(Arguments *arguments) {
+    FileInfo file_info = {0};
+    file_info.size = arguments->hash_size;
+    file_info.name = arguments->hash_name;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Unable to create hashing context\n");
+        exit(EXIT_FAILURE);
+    }
+    compute_and_store_hash(&file_info, ctx);
+    EVP_MD_CTX_free(ctx);
+    arguments->hash_value = file_info.hash;
+    arguments->hash = malloc(HASH_HEX_LENGTH);
+    if (arguments->hash == NULL) {
+        perror("Failed to allocate memory for args->hash");
+        exit(EXIT_FAILURE);
+    }
+    hash_to_hex(file_info.hash, arguments->hash);
 }
 
 int main(const int argc, char *argv[]) {
     struct timeval start, end;
     const int maxThreads = initialize_threads();
 
-    bool (*match_function)(const char *, char **) = NULL;
-
     Arguments arguments = {0};
     parse_arguments(argc, argv, &arguments);
 
@@ -267,7 +306,6 @@ int main(const int argc, char *argv[]) {
             for (int i = 0; i < arguments.names_count; i++) {
                 printf("  - %s\n", arguments.names[i]);
             }
-            match_function = match_by_name;
         }
     }
     if (arguments.paths != NULL) {
@@ -276,7 +314,6 @@ int main(const int argc, char *argv[]) {
             for (int i = 0; i < arguments.paths_count; i++) {
                 printf("  - %s\n", arguments.paths[i]);
             }
-            match_function = match_by_path;
         }
     }
     if (arguments.hashes != NULL) {
@@ -285,38 +322,78 @@ int main(const int argc, char *argv[]) {
             for (int i = 0; i < arguments.hashes_count; i++) {
                 printf("  - %s\n", arguments.hashes[i]);
             }
-            match_function = match_by_hash;
         }
     }
-    if (arguments.hash != NULL) {
-        match_function = match_by_hash;
-        printf("Looking for hash %s\n", arguments.hash);
-        printf("----------------------------------\n");
-    }
     if (arguments.size >= 0) {
-        match_function = match_by_size;
         printf("Looking for size %d\n", arguments.size);
         printf("----------------------------------\n");
     }
-    if (arguments.names == NULL && arguments.paths == NULL && arguments.hash == NULL && arguments.size == 0 && (arguments.size_lower_bound > 0 || arguments.size_upper_bound > 0)) {
-        match_function = match_by_size;
-    }
     if (arguments.type) printf("Type: %s\n", arguments.type);
-    Node *root = load_tree_from_shared_memory(arguments.mem_filename);
+    size_t mappedLength = 0;
+    const char *mapped = map_shared_memory_index(arguments.mem_filename, &mappedLength);
+    if (mapped == NULL) {
+        free_arguments(&arguments);
+        exit(EXIT_FAILURE);
+    }
+    // The header says what the index holds; a damaged or stale one is rejected before any query runs
+    const IndexHeader *header = index_header(mapped, mappedLength);
+    arguments.records = index_records(header);
+    printf("Index: %s ordered by %s, %llu records, %s hashes\n",
+           header->layout == INDEX_LAYOUT_EYTZINGER ? "Eytzinger index" : "red-black tree",
+           index_key_name((IndexKey) header->key), (unsigned long long) header->count,
+           hash_algorithm_name((HashAlgorithm) header->hashAlgorithm));
+    if (arguments.verify) {
+        if (!index_data_intact(header)) {
+            fprintf(stderr, "Error: Checksum mismatch in %s, the index is corrupt.\n", arguments.mem_filename);
+            free_arguments(&arguments);
+            exit(EXIT_FAILURE);
+        }
+        printf("Index checksum verified\n");
+    }
+    // Names are hashed the way the index hashed them
+    set_hash_algorithm((HashAlgorithm) header->hashAlgorithm);
+    if (arguments.hash_name != NULL) {
+        hash_file_name_and_size(&arguments);
+        printf("Looking for hash %s (%s)\n", arguments.hash, hash_algorithm_name(current_hash_algorithm()));
+        printf("----------------------------------\n");
+    }
+    // Static size and hash indexes have their own lookup path
+    if (header->layout == INDEX_LAYOUT_EYTZINGER) {
+        eytzinger_query(mapped, header, &arguments);
+        free_arguments(&arguments);
+        exit(EXIT_SUCCESS);
+    }
+    const PackedNode *root = index_tree_root(header);
+    if (has_order_statistics_query(&arguments)) {
+        order_statistics_query(header, &arguments);
+        free_arguments(&arguments);
+        exit(EXIT_SUCCESS);
+    }
     if (arguments.duplicates){
         detect_duplicates(root, &arguments);
         free_arguments(&arguments);
         exit(EXIT_SUCCESS);
     }
-    MapResults results = {NULL, 0};
+    MapResults results = {0};
     long long totalCount = arguments.names_count > 1 || arguments.paths_count > 1 ? -1 : 0;
 
     if (arguments.filename != NULL) {
-        parallel_file_processing(arguments.filename, root, maxThreads);
+        parallel_file_processing(arguments.filename, root, arguments.records, maxThreads);
         free_arguments(&arguments);
         exit(EXIT_SUCCESS);
     }
-    search_tree(root, arguments, match_function, &results, &totalCount);
+    // Patterns are compiled once here; every node visited by the search threads reuses them
+    compile_query_matchers(&arguments);
+    if (arguments.matchers_count > 1) {
+        map_results_reserve_buckets(&results, arguments.matchers_count);
+    }
+    if (plan_prefix_scan(&arguments, header)) {
+        printf("Plan: prefix range scan in %s order\n", index_key_name((IndexKey) header->key));
+    }
+    if (plan_size_scan(&arguments, header)) {
+        printf("Plan: %d size range(s) scanned in size order\n", arguments.size_ranges_count);
+    }
+    search_tree(root, arguments, &results, &totalCount);
     if (arguments.names_count > 1 || arguments.paths_count > 1 || arguments.hashes_count > 1) {
         print_results(&results);
     }
@@ -13,7 +13,15 @@ DEFINE_NUMERIC_COMPARATOR(size)
 int main(const int argc, char *argv[]) {
     const char *prefix = "rbt_size_";
 
-    createRbt(argc, argv, insert_size, prefix);
+    const Config config = {
+        .prefix = prefix,
+        .insert_fn = insert_size,
+        .compare_fn = compareBysize,
+        .filename = argc > 2 ? argv[2] : NULL,
+        .hashAlgorithm = HASH_ALGORITHM_DEFAULT,
+    };
+
+    createRbt(argc, argv, compareBysize, prefix, config);
 
     return EXIT_SUCCESS;
 }
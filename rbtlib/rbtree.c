@@ -1,7 +1,19 @@
+#define _GNU_SOURCE // mremap
+
 #include "rbtree.h"
+#include "lowercase_table.h"
 
 #include <openssl/sha.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <sys/time.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#include <sys/sendfile.h>
 
 #include "../shared/shared.h"
 #include "../shared/lconsts.h"
@@ -20,132 +32,412 @@ char *get_filename_from_path(const char *path) {
     return slash ? strdup(slash + 1) : strdup(path); // Duplicate the file name
 }
 
+// Hash algorithm of the process; set once, before any thread hashes, from the option or the index header
+static HashAlgorithm hashAlgorithm = HASH_ALGORITHM_DEFAULT;
+
+void set_hash_algorithm(const HashAlgorithm algorithm) {
+    hashAlgorithm = algorithm;
+}
+
+HashAlgorithm current_hash_algorithm(void) {
+    return hashAlgorithm;
+}
+
+const char *hash_algorithm_name(const HashAlgorithm algorithm) {
+    return algorithm == HASH_SHA256 ? "sha256" : "xxh64";
+}
+
+bool parse_hash_algorithm(const char *name, HashAlgorithm *algorithm) {
+    if (strcmp(name, "sha256") == 0) {
+        *algorithm = HASH_SHA256;
+    } else if (strcmp(name, "xxh64") == 0) {
+        *algorithm = HASH_XXH64;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl64(const uint64_t x, const int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t xxh_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, const uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, const uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**
+ * XXH64 of length bytes (little-endian reads, as on every platform this builds on). Names plus sizes
+ * are short, so most of them take the tail loops only.
+ */
+uint64_t xxh64(const void *input, const size_t length, const uint64_t seed) {
+    const unsigned char *p = input;
+    const unsigned char *end = p + length;
+    uint64_t h;
+    if (length >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh64_round(v1, xxh_read64(p));
+            v2 = xxh64_round(v2, xxh_read64(p + 8));
+            v3 = xxh64_round(v3, xxh_read64(p + 16));
+            v4 = xxh64_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        h = xxh64_merge_round(h, v1);
+        h = xxh64_merge_round(h, v2);
+        h = xxh64_merge_round(h, v3);
+        h = xxh64_merge_round(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t) length;
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh64_round(0, xxh_read64(p));
+        h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) xxh_read32(p) * XXH_PRIME64_1;
+        h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH_PRIME64_5;
+        h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// 64-bit hash of the lowercased name followed by the size; ctx is only used by SHA-256
 void compute_and_store_hash(FileInfo *result, EVP_MD_CTX *ctx) {
-    char hash[17];
     char hash_input[LINK_LENGTH];
 
     concatenate_name_and_size(result, hash_input);
-    sha256_first_64bits_to_hex(hash_input, hash, ctx);
+    if (hashAlgorithm == HASH_XXH64) {
+        result->hash = xxh64(hash_input, strlen(hash_input), 0);
+    } else {
+        result->hash = sha256_first_64bits(hash_input, ctx);
+    }
+}
+
+// Render a hash as the 16 lowercase hex digits it is shown and queried as
+void hash_to_hex(const uint64_t hash, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 15; i >= 0; i--) {
+        hex[15 - i] = digits[hash >> (i * 4) & 0xF];
+    }
+    hex[16] = '\0';
+}
 
-    memcpy(result->hash, hash, 17);
+// Parse a hash given as up to 16 hex digits; false when hex is anything else
+bool hex_to_hash(const char *hex, uint64_t *hash) {
+    const size_t length = strlen(hex);
+    if (length == 0 || length > 16) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i++) {
+        const char c = hex[i];
+        const int digit = c >= '0' && c <= '9' ? c - '0'
+                          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                          : -1;
+        if (digit < 0) {
+            return false;
+        }
+        value = value << 4 | (uint64_t) digit;
+    }
+    *hash = value;
+    return true;
 }
 
-// File parsing into FileInfo
-void parseFileData(const char *inputLine, FileInfo *result, EVP_MD_CTX *ctx) {
-    char *lineCopy = strdup(inputLine);
+// strtok-like scan of the SEP-separated fields of a line span: separators in a row count as one
+typedef struct FieldCursor {
+    const char *at;
+    const char *end;
+} FieldCursor;
 
-    if (!lineCopy) {
-        perror("Failed to duplicate the input line");
-        exit(EXIT_FAILURE);
+static bool next_field(FieldCursor *cursor, const char **field, size_t *length) {
+    while (cursor->at < cursor->end && *cursor->at == *SEP) {
+        cursor->at++;
+    }
+    if (cursor->at == cursor->end) {
+        return false;
+    }
+    const char *stop = memchr(cursor->at, *SEP, cursor->end - cursor->at);
+    if (!stop) {
+        stop = cursor->end;
+    }
+    *field = cursor->at;
+    *length = stop - cursor->at;
+    cursor->at = stop < cursor->end ? stop + 1 : stop;
+    return true;
+}
+
+static bool field_is(const char *field, const size_t length, const char *literal) {
+    return length == strlen(literal) && memcmp(field, literal, length) == 0;
+}
+
+// Decimal field as strtol reads it; false unless the whole field is the number
+static bool parse_field_number(const char *field, const size_t length, long *value) {
+    char digits[32];
+    if (length >= sizeof(digits)) {
+        return false;
+    }
+    memcpy(digits, field, length);
+    digits[length] = '\0';
+    char *endptr;
+    *value = strtol(digits, &endptr, 10);
+    return *endptr == '\0';
+}
+
+// Keep the rest of the line after L_TARGET, separators included, as the link target
+static void store_link_target(FieldCursor *cursor, FileInfo *result, StringPool *pool) {
+    if (cursor->at < cursor->end) {
+        result->linkTarget = string_pool_store(pool, cursor->at, cursor->end - cursor->at);
+        cursor->at = cursor->end;
+    } else {
+        fprintf(stderr, "Missing target path after L_TARGET: %s\n", result->path);
     }
+}
 
-    const size_t len = strlen(lineCopy);
-    if (len > 0 && lineCopy[len - 1] == '\n') {
-        lineCopy[len - 1] = '\0';
+// File parsing into FileInfo; the strings are copied into the calling thread's string pool
+void parseFileData(const char *inputLine, FileInfo *result, EVP_MD_CTX *ctx) {
+    size_t length = strlen(inputLine);
+    if (length > 0 && inputLine[length - 1] == '\n') {
+        length--;
     }
+    parse_line_span(inputLine, length, result, ctx);
+}
 
-    if (strstr(lineCopy, "F_HIDDEN") != NULL) {
+/**
+ * Parses a listing line given as a span, which need not be NUL-terminated, into FileInfo. Fields are
+ * read in place, so lines of a mapped listing are never copied; only the strings kept by the record go
+ * into the calling thread's string pool.
+ */
+void parse_line_span(const char *line, const size_t length, FileInfo *result, EVP_MD_CTX *ctx) {
+    if (memmem(line, length, "F_HIDDEN", strlen("F_HIDDEN")) != NULL) {
         result->isHidden = true;
     }
-    char *token = strtok(lineCopy, SEP);
+    StringPool *pool = string_pool_current();
+    FieldCursor cursor = {line, line + length};
+    const char *field;
+    size_t fieldLength;
 
-    strcpy(result->path, token);
-    strcpy(result->name, get_filename_from_path(result->path));
-    token = strtok(NULL, SEP);
-    char *endptr;
-    result->size = strtol(token, &endptr, 10);
-    if (*endptr != '\0') {
-        fprintf(stderr, "Invalid numeric format for size in line: %s\n", lineCopy);
+    if (!next_field(&cursor, &field, &fieldLength)) {
+        return;
+    }
+    result->path = string_pool_store(pool, field, fieldLength);
+    const char *slash = strrchr(result->path, '/');
+    result->name = slash ? slash + 1 : result->path;
+    long number;
+    if (!next_field(&cursor, &field, &fieldLength) || !parse_field_number(field, fieldLength, &number)) {
+        fprintf(stderr, "Invalid numeric format for size in line: %.*s\n", (int) length, line);
         exit(EXIT_FAILURE);
     }
+    result->size = number;
 
-    token = strtok(NULL, SEP);
-    if (!token) {
-        fprintf(stderr, "Error parsing type in line: %s\n", lineCopy);
+    if (!next_field(&cursor, &field, &fieldLength)) {
+        fprintf(stderr, "Error parsing type in line: %.*s\n", (int) length, line);
+        exit(EXIT_FAILURE);
+    }
+    result->type = file_type_from_name(field, fieldLength);
+    if (result->type == FILE_TYPE_INVALID) {
+        fprintf(stderr, "Unknown type in line: %.*s\n", (int) length, line);
         exit(EXIT_FAILURE);
     }
-    strcpy(result->type, token);
 
-    if (strcmp(result->type, "T_LINK_FILE") == 0) {
+    if (result->type == T_LINK_FILE) {
         result->isLink = 1;
-        token = strtok(NULL, SEP);
-        if (strncmp(token, "L_TARGET", 9) == 0) {
-            if (token != NULL) {
-                strcpy(result->linkTarget, token);
-            } else {
-                fprintf(stderr, "Missing target path after L_TARGET: %s\n", result->type);
-            }
+        if (next_field(&cursor, &field, &fieldLength) && field_is(field, fieldLength, "L_TARGET")) {
+            store_link_target(&cursor, result, pool);
         }
     }
     // Check if the entry is a directory and process extra flags
-    if (strcmp(result->type, "T_DIR") == 0 || strcmp(result->type, "T_LINK_DIR") == 0) {
-        if (strcmp(result->type, "T_DIR") == 0) {
+    if (result->type == T_DIR || result->type == T_LINK_DIR) {
+        if (result->type == T_DIR) {
             result->isDir = true;
-        } else if (strcmp(result->type, "T_LINK_DIR") == 0) {
+        } else {
             result->isLink = 2;
         }
         // Look for additional flags (e.g., C_COUNT and F_HIDDEN)
-        token = strtok(NULL, SEP);
-        while (token) {
-            if (strncmp(token, "C_COUNT", 8) == 0) {
-                token = strtok(NULL, SEP);
-                result->childrenCount = strtol(token, &endptr, 10);
-                if (*endptr != '\0') {
-                    fprintf(stderr, "Invalid numeric format in C_COUNT: %s\n", token);
+        while (next_field(&cursor, &field, &fieldLength)) {
+            if (field_is(field, fieldLength, "C_COUNT")) {
+                if (!next_field(&cursor, &field, &fieldLength)) {
+                    break;
                 }
-            } else if (strncmp(token, "L_TARGET", 9) == 0) {
-                token = strtok(NULL, ""); // Get the rest of the string after "L_TARGET"
-                if (token != NULL) {
-                    strcpy(result->linkTarget, token);
+                if (parse_field_number(field, fieldLength, &number)) {
+                    result->childrenCount = number;
                 } else {
-                    fprintf(stderr, "Missing target path after L_TARGET: %s\n", result->path);
+                    fprintf(stderr, "Invalid numeric format in C_COUNT: %.*s\n", (int) fieldLength, field);
                 }
+            } else if (field_is(field, fieldLength, "L_TARGET")) {
+                store_link_target(&cursor, result, pool);
             }
-            token = strtok(NULL, SEP);
         }
     }
     compute_and_store_hash(result, ctx);
+}
 
-    free(lineCopy);
+// String pool of the calling thread; holds the strings of every FileInfo parsed or loaded on it
+static _Thread_local StringPool threadStringPool = {NULL, 0};
+
+StringPool *string_pool_current(void) {
+    return &threadStringPool;
+}
+
+// Copy `length` bytes of `str` into the pool and NUL-terminate them
+const char *string_pool_store(StringPool *pool, const char *str, const size_t length) {
+    StringChunk *chunk = pool->chunks;
+    if (!chunk || chunk->capacity - chunk->used < length + 1) {
+        const size_t capacity = length + 1 > STRING_POOL_CHUNK_BYTES ? length + 1 : STRING_POOL_CHUNK_BYTES;
+        chunk = malloc(sizeof(StringChunk) + capacity);
+        if (!chunk) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    chunk->used += length + 1;
+    pool->bytes += length + 1;
+    return copy;
+}
+
+// Move every chunk of from into pool, leaving from empty
+void string_pool_adopt(StringPool *pool, StringPool *from) {
+    if (!from->chunks) {
+        return;
+    }
+    StringChunk *last = from->chunks;
+    while (last->next) {
+        last = last->next;
+    }
+    // The newest chunk of pool stays in front so it keeps filling up
+    if (pool->chunks) {
+        last->next = pool->chunks->next;
+        pool->chunks->next = from->chunks;
+    } else {
+        pool->chunks = from->chunks;
+    }
+    pool->bytes += from->bytes;
+    *from = (StringPool){NULL, 0};
+}
+
+// Free every chunk of the pool, invalidating all strings stored in it
+void string_pool_release(StringPool *pool) {
+    StringChunk *chunk = pool->chunks;
+    while (chunk) {
+        StringChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    pool->chunks = NULL;
+    pool->bytes = 0;
+}
+
+// Node arena of the calling thread; every tree built or loaded on a thread lives in it
+static _Thread_local NodeArena threadNodeArena = {NULL, 0};
+
+NodeArena *node_arena_current(void) {
+    return &threadNodeArena;
+}
+
+// Hand out the next free node, opening a new slab when the current one is full
+Node *node_arena_alloc(NodeArena *arena) {
+    NodeSlab *slab = arena->slabs;
+    if (!slab || slab->used == slab->capacity) {
+        const size_t capacity = (NODE_SLAB_BYTES - sizeof(NodeSlab)) / sizeof(Node);
+        slab = malloc(sizeof(NodeSlab) + (capacity > 0 ? capacity : 1) * sizeof(Node));
+        if (!slab) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        slab->used = 0;
+        slab->capacity = capacity > 0 ? capacity : 1;
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+    }
+    arena->count++;
+    return &slab->nodes[slab->used++];
+}
+
+// Free every slab of the arena, invalidating all nodes allocated from it
+void node_arena_release(NodeArena *arena) {
+    NodeSlab *slab = arena->slabs;
+    while (slab) {
+        NodeSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    arena->slabs = NULL;
+    arena->count = 0;
 }
 
 // Tree Node Allocation
 Node *createNode(const FileInfo key, const NodeColor color, Node *parent) {
-    Node *node = (Node *) malloc(sizeof(Node));
-    if (!node) {
-        fprintf(stderr, "Memory allocation error\n");
-        exit(EXIT_FAILURE);
-    }
+    Node *node = node_arena_alloc(node_arena_current());
     node->key = key;
     node->left = node->right = NULL;
     node->parent = parent;
     node->color = color;
+    node->count = 1;
+    node->sum = key.size;
     return node;
 }
 
-// Free FileInfo
-void freeFileInfo(FileInfo *fileInfo) {
-    free(fileInfo);
-}
-
-// Free Tree
-void freeTree(Node *node) {
-    if (!node) return;
-    freeTree(node->left);
-    freeTree(node->right);
-    freeFileInfo(&node->key);
+// Nodes come from the calling thread's arena, so this frees every tree built on that thread at once
+void release_thread_trees(void) {
+    node_arena_release(node_arena_current());
 }
 
 void insert(Node **root, const FileInfo key, int (*comparator)(const FileInfo *, const FileInfo *)) {
     // Allocate and initialize the new node
-    Node *n = malloc(sizeof(Node));
-    if (!n) {
-        fprintf(stderr, "Memory allocation error\n");
-        exit(EXIT_FAILURE);
-    }
+    Node *n = node_arena_alloc(node_arena_current());
 
     n->key = key;
     n->color = RED;
+    n->count = 1;
+    n->sum = key.size;
     n->left = n->right = n->parent = NULL;
 
     // Standard BST insertion (now comparing filenames)
@@ -154,6 +446,9 @@ void insert(Node **root, const FileInfo key, int (*comparator)(const FileInfo *,
 
     while (x != NULL) {
         y = x;
+        // The new node ends up below every node on the way down
+        x->count++;
+        x->sum += key.size;
         if (comparator(&n->key, &x->key) < 0) // Use comparator to determine order
             x = x->left;
         else
@@ -216,94 +511,595 @@ void insert_rebalance(Node **root, Node *n) {
     (*root)->color = BLACK; // Ensure root remains black
 }
 
-// Serializing and Deserializing implementations
-size_t serialize_file_info(const FileInfo *fileInfo, char *buffer) {
-    size_t offset = 0;
-    size_t length;
+// Replace the subtree rooted at u by the one rooted at v
+static void transplant(Node **root, const Node *u, Node *v) {
+    if (!u->parent) {
+        *root = v;
+    } else if (u == u->parent->left) {
+        u->parent->left = v;
+    } else {
+        u->parent->right = v;
+    }
+    if (v) {
+        v->parent = u->parent;
+    }
+}
+
+// Recompute the subtree count and sum of node and of all its ancestors
+static void refresh_subtree_totals(Node *node) {
+    for (; node; node = node->parent) {
+        node->count = node_count(node->left) + node_count(node->right) + 1;
+        node->sum = node_sum(node->left) + node_sum(node->right) + node->key.size;
+    }
+}
+
+/**
+ * Unlinks z from the tree and restores the red-black properties. The node stays in its arena
+ * until the whole tree is freed.
+ */
+void delete_node(Node **root, Node *z) {
+    Node *y = z; // Node actually spliced out of its position
+    NodeColor removedColor = y->color;
+    Node *x; // Node that moves into y's position, possibly NULL
+    Node *xParent;
+
+    if (!z->left) {
+        x = z->right;
+        xParent = z->parent;
+        transplant(root, z, z->right);
+    } else if (!z->right) {
+        x = z->left;
+        xParent = z->parent;
+        transplant(root, z, z->left);
+    } else {
+        // Two children: the in-order successor takes z's place
+        y = z->right;
+        while (y->left) {
+            y = y->left;
+        }
+        removedColor = y->color;
+        x = y->right;
+        if (y->parent == z) {
+            xParent = y;
+        } else {
+            xParent = y->parent;
+            transplant(root, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        transplant(root, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->color = z->color;
+    }
+    // Every subtree that lost a node lies on the path from xParent to the root
+    refresh_subtree_totals(xParent);
+
+    if (removedColor == BLACK) {
+        delete_rebalance(root, x, xParent);
+    }
+}
+
+// Fix-up after removing a black node; x carries the extra black and may be NULL, hence the explicit parent
+void delete_rebalance(Node **root, Node *x, Node *parent) {
+    while (x != *root && (!x || x->color == BLACK)) {
+        if (x == parent->left) {
+            Node *w = parent->right; // Sibling
+            if (w->color == RED) {
+                // Case 1: Red sibling, rotate it above the parent
+                w->color = BLACK;
+                parent->color = RED;
+                ROTATE_LEFT(root, parent);
+                w = parent->right;
+            }
+            if ((!w->left || w->left->color == BLACK) && (!w->right || w->right->color == BLACK)) {
+                // Case 2: Recoloring moves the extra black up
+                w->color = RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!w->right || w->right->color == BLACK) {
+                    // Case 3: Right rotation of the sibling
+                    w->left->color = BLACK;
+                    w->color = RED;
+                    ROTATE_RIGHT(root, w);
+                    w = parent->right;
+                }
+                // Case 4: Left rotation of the parent absorbs the extra black
+                w->color = parent->color;
+                parent->color = BLACK;
+                if (w->right) {
+                    w->right->color = BLACK;
+                }
+                ROTATE_LEFT(root, parent);
+                x = *root;
+            }
+        } else {
+            Node *w = parent->left;
+            if (w->color == RED) {
+                w->color = BLACK;
+                parent->color = RED;
+                ROTATE_RIGHT(root, parent);
+                w = parent->left;
+            }
+            if ((!w->left || w->left->color == BLACK) && (!w->right || w->right->color == BLACK)) {
+                w->color = RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!w->left || w->left->color == BLACK) {
+                    w->right->color = BLACK;
+                    w->color = RED;
+                    ROTATE_LEFT(root, w);
+                    w = parent->left;
+                }
+                w->color = parent->color;
+                parent->color = BLACK;
+                if (w->left) {
+                    w->left->color = BLACK;
+                }
+                ROTATE_RIGHT(root, parent);
+                x = *root;
+            }
+        }
+    }
+    if (x) {
+        x->color = BLACK;
+    }
+}
+
+/**
+ * Finds the node holding the entry of key->path among the nodes that compare equal to key.
+ * Equal keys are adjacent in order, so this is a descent to the first of them plus a scan over the run.
+ */
+Node *find_node(Node *root, const FileInfo *key, int (*comparator)(const FileInfo *, const FileInfo *)) {
+    const Node *first = NULL;
+    for (const Node *x = root; x;) {
+        if (comparator(&x->key, key) < 0) {
+            x = x->right;
+        } else {
+            first = x;
+            x = x->left;
+        }
+    }
+    for (const Node *x = first; x && comparator(&x->key, key) == 0; x = tree_inorder_next(root, x)) {
+        if (strcmp(x->key.path, key->path) == 0) {
+            return (Node *) x;
+        }
+    }
+    return NULL;
+}
+
+// Runs shorter than this are sorted by insertion before merging
+#define SORT_RUN_LENGTH 32
+
+// Merge the sorted runs src[lo, mid) and src[mid, hi) into dst[lo, hi); ties keep the left run first
+static void merge_node_runs(Node **src, Node **dst, const size_t lo, const size_t mid, const size_t hi,
+                            int (*comparator)(const FileInfo *, const FileInfo *)) {
+    size_t i = lo, j = mid, k = lo;
+    while (i < mid && j < hi) {
+        dst[k++] = comparator(&src[j]->key, &src[i]->key) < 0 ? src[j++] : src[i++];
+    }
+    while (i < mid) dst[k++] = src[i++];
+    while (j < hi) dst[k++] = src[j++];
+}
+
+/**
+ * Stable sort of node pointers by key. Listings produced by list_files are already sorted by path,
+ * so a single pass first checks whether there is anything to do at all.
+ */
+void sort_nodes(Node **nodes, const size_t count, int (*comparator)(const FileInfo *, const FileInfo *)) {
+    size_t sorted = 1;
+    while (sorted < count && comparator(&nodes[sorted - 1]->key, &nodes[sorted]->key) <= 0) {
+        sorted++;
+    }
+    if (sorted >= count) {
+        return;
+    }
+    // Insertion sort of short runs
+    for (size_t lo = 0; lo < count; lo += SORT_RUN_LENGTH) {
+        const size_t hi = lo + SORT_RUN_LENGTH < count ? lo + SORT_RUN_LENGTH : count;
+        for (size_t i = lo + 1; i < hi; i++) {
+            Node *current = nodes[i];
+            size_t j = i;
+            while (j > lo && comparator(&current->key, &nodes[j - 1]->key) < 0) {
+                nodes[j] = nodes[j - 1];
+                j--;
+            }
+            nodes[j] = current;
+        }
+    }
+    // Bottom-up merging, ping-ponging between the input and a scratch array
+    Node **scratch = malloc(count * sizeof(Node *));
+    if (!scratch) {
+        perror("Failed to allocate memory for sorting");
+        exit(EXIT_FAILURE);
+    }
+    Node **src = nodes, **dst = scratch;
+    for (size_t width = SORT_RUN_LENGTH; width < count; width *= 2) {
+        for (size_t lo = 0; lo < count; lo += 2 * width) {
+            const size_t mid = lo + width < count ? lo + width : count;
+            const size_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+            merge_node_runs(src, dst, lo, mid, hi, comparator);
+        }
+        Node **tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != nodes) {
+        memcpy(nodes, src, count * sizeof(Node *));
+    }
+    free(scratch);
+}
+
+// Link nodes[lo, hi) into a subtree rooted at its middle element; nodes on the last, partially filled level are red
+static Node *link_balanced_subtree(Node **nodes, const size_t lo, const size_t hi, Node *parent, const int depth,
+                                   const int redDepth) {
+    if (lo >= hi) {
+        return NULL;
+    }
+    const size_t mid = lo + (hi - lo) / 2;
+    Node *node = nodes[mid];
+    node->parent = parent;
+    node->color = depth == redDepth ? RED : BLACK;
+    node->count = hi - lo;
+    node->left = link_balanced_subtree(nodes, lo, mid, node, depth + 1, redDepth);
+    node->right = link_balanced_subtree(nodes, mid + 1, hi, node, depth + 1, redDepth);
+    node->sum = node_sum(node->left) + node_sum(node->right) + node->key.size;
+    return node;
+}
 
-    length = strlen(fileInfo->name) + 1;
-    memcpy(buffer + offset, &length, sizeof(size_t));
-    offset += sizeof(size_t);
-    memcpy(buffer + offset, fileInfo->name, length);
-    offset += length;
+/**
+ * Builds a valid red-black tree from nodes already sorted by key in O(n). Splitting at the middle keeps
+ * all leaves within one level of each other, so the tree is black except for the bottom level when
+ * that level is not full.
+ */
+Node *build_balanced_tree(Node **nodes, const size_t count) {
+    if (count == 0) {
+        return NULL;
+    }
+    int levels = 0;
+    while (((size_t) 1 << levels) <= count) {
+        levels++;
+    }
+    const bool perfect = ((count + 1) & count) == 0;
+    Node *root = link_balanced_subtree(nodes, 0, count, NULL, 0, perfect ? -1 : levels - 1);
+    root->color = BLACK;
+    return root;
+}
 
-    memcpy(buffer + offset, &fileInfo->size, sizeof(size_t));
-    offset += sizeof(size_t);
+// Sort the nodes (unless they are already in order) and build a balanced red-black tree over them
+Node *bulk_load_tree(Node **nodes, const size_t count, int (*comparator)(const FileInfo *, const FileInfo *)) {
+    sort_nodes(nodes, count, comparator);
+    return build_balanced_tree(nodes, count);
+}
 
-    length = strlen(fileInfo->path) + 1;
-    memcpy(buffer + offset, &length, sizeof(size_t));
-    offset += sizeof(size_t);
-    memcpy(buffer + offset, fileInfo->path, length);
-    offset += length;
+// Number of black nodes on any path from root down to a NULL leaf
+static int black_height(const Node *root) {
+    int height = 0;
+    for (; root; root = root->left) {
+        height += root->color == BLACK;
+    }
+    return height;
+}
 
-    length = strlen(fileInfo->type) + 1;
-    memcpy(buffer + offset, &length, sizeof(size_t));
-    offset += sizeof(size_t);
-    memcpy(buffer + offset, fileInfo->type, length);
-    offset += length;
+/**
+ * Joins two red-black trees around a separator node, every key of left ordering before separator and
+ * every key of right after it. The separator is hung off the spine of the taller tree at the first black
+ * node whose black height matches the shorter tree and the red-red violation is fixed upwards, so the
+ * join costs O(|bh(left) - bh(right)| + log n). Both roots must be black.
+ */
+Node *join_trees(Node *left, Node *separator, Node *right) {
+    const int leftHeight = black_height(left);
+    const int rightHeight = black_height(right);
+    separator->color = RED;
+    if (leftHeight == rightHeight) {
+        separator->left = left;
+        separator->right = right;
+        separator->parent = NULL;
+        separator->color = BLACK;
+        if (left) {
+            left->parent = separator;
+        }
+        if (right) {
+            right->parent = separator;
+        }
+        refresh_subtree_totals(separator);
+        return separator;
+    }
+    Node *root = leftHeight > rightHeight ? left : right;
+    const int target = leftHeight > rightHeight ? rightHeight : leftHeight;
+    int height = leftHeight > rightHeight ? leftHeight : rightHeight;
+    Node *parent = NULL;
+    Node *spine = root;
+    // Walk the inner spine of the taller tree down to a black node of the shorter tree's black height
+    while (spine && !(spine->color == BLACK && height == target)) {
+        height -= spine->color == BLACK;
+        parent = spine;
+        spine = leftHeight > rightHeight ? spine->right : spine->left;
+    }
+    separator->parent = parent;
+    if (leftHeight > rightHeight) {
+        separator->left = spine;
+        separator->right = right;
+        parent->right = separator;
+    } else {
+        separator->left = left;
+        separator->right = spine;
+        parent->left = separator;
+    }
+    if (separator->left) {
+        separator->left->parent = separator;
+    }
+    if (separator->right) {
+        separator->right->parent = separator;
+    }
+    refresh_subtree_totals(separator);
+    insert_rebalance(&root, separator);
+    return root;
+}
 
-    length = strlen(fileInfo->hash) + 1; // Include null terminator
-    memcpy(buffer + offset, &length, sizeof(size_t));
-    offset += sizeof(size_t);
-    memcpy(buffer + offset, fileInfo->hash, length);
-    offset += length;
+// Partitions no larger than this are not worth a thread of their own
+#define PARALLEL_BUILD_MIN_PARTITION 32768
+// Keys sampled per partition when choosing splitters
+#define PARALLEL_BUILD_OVERSAMPLING 64
+
+// One worker's share of a parallel bulk load
+typedef struct PartitionTask {
+    Node **nodes; // Input slice to classify and scatter
+    size_t count;
+    uint16_t *buckets; // Partition of every node in the slice
+    size_t *offsets; // Per partition: nodes of the slice in it, then where the slice scatters to
+    Node **partitioned;
+    Node **splitters;
+    size_t splitterCount;
+    int (*comparator)(const FileInfo *, const FileInfo *);
+    Node *root; // Subtree over one sorted partition but its smallest node
+    Node *separator; // Smallest node of the partition, joins it to the partitions before it
+} PartitionTask;
+
+// Count the slice's nodes per partition: a node goes after every splitter not greater than it
+static void *classify_partition_slice(void *arg) {
+    const PartitionTask *task = arg;
+    for (size_t i = 0; i < task->count; i++) {
+        size_t lo = 0, hi = task->splitterCount;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (task->comparator(&task->splitters[mid]->key, &task->nodes[i]->key) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        task->buckets[i] = (uint16_t) lo;
+        task->offsets[lo]++;
+    }
+    return NULL;
+}
 
-    return offset;
+// Move the slice's nodes to their partitions, keeping their input order so equal keys stay stable
+static void *scatter_partition_slice(void *arg) {
+    const PartitionTask *task = arg;
+    for (size_t i = 0; i < task->count; i++) {
+        task->partitioned[task->offsets[task->buckets[i]]++] = task->nodes[i];
+    }
+    return NULL;
 }
 
-// Deserialize a FileInfo from the buffer
-size_t deserialize_file_info(FileInfo *fileInfo, const char *buffer) {
-    size_t offset = 0;
-    size_t length;
+static void *build_partition_tree(void *arg) {
+    PartitionTask *task = arg;
+    if (task->count == 0) {
+        return NULL;
+    }
+    sort_nodes(task->nodes, task->count, task->comparator);
+    task->separator = task->nodes[0];
+    task->root = build_balanced_tree(task->nodes + 1, task->count - 1);
+    return NULL;
+}
+
+// Run worker on every task, the first one on the calling thread
+static void run_partition_tasks(PartitionTask *tasks, const size_t taskCount, void *(*worker)(void *)) {
+    pthread_t threads[taskCount];
+    for (size_t i = 1; i < taskCount; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &tasks[i]) != 0) {
+            fprintf(stderr, "Failed to create thread: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    worker(&tasks[0]);
+    for (size_t i = 1; i < taskCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
 
-    // Deserialize name
-    memcpy(&length, buffer + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+/**
+ * bulk_load_tree spread over threads. Splitters picked from an evenly spaced sample of the keys cut the
+ * nodes into one partition per thread; the threads classify and scatter their slices of the input, then
+ * each sorts its partition and builds a balanced subtree over it. The subtrees are joined in key order,
+ * each around its partition's smallest node. Nodes are only relinked, so they may come from any arena.
+ */
+Node *parallel_bulk_load_tree(Node **nodes, const size_t count, int (*comparator)(const FileInfo *, const FileInfo *),
+                              size_t threads) {
+    if (threads > count / PARALLEL_BUILD_MIN_PARTITION) {
+        threads = count / PARALLEL_BUILD_MIN_PARTITION;
+    }
+    if (threads > UINT16_MAX) {
+        threads = UINT16_MAX;
+    }
+    if (threads < 2) {
+        return bulk_load_tree(nodes, count, comparator);
+    }
+    // Splitters from a sorted sample of the keys
+    const size_t sampleCount = threads * PARALLEL_BUILD_OVERSAMPLING;
+    Node **sample = malloc(sampleCount * sizeof(Node *));
+    uint16_t *buckets = malloc(count * sizeof(uint16_t));
+    Node **partitioned = malloc(count * sizeof(Node *));
+    size_t *offsets = calloc(threads * threads, sizeof(size_t));
+    PartitionTask *tasks = calloc(threads, sizeof(PartitionTask));
+    if (!sample || !buckets || !partitioned || !offsets || !tasks) {
+        perror("Failed to allocate memory for the parallel tree build");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < sampleCount; i++) {
+        sample[i] = nodes[i * (count / sampleCount)];
+    }
+    sort_nodes(sample, sampleCount, comparator);
+    Node *splitters[threads - 1];
+    for (size_t i = 1; i < threads; i++) {
+        splitters[i - 1] = sample[i * PARALLEL_BUILD_OVERSAMPLING];
+    }
+
+    // Classify each slice of the input, then scatter it to offsets from the prefix sums of the counts
+    const size_t slice = (count + threads - 1) / threads;
+    for (size_t t = 0; t < threads; t++) {
+        const size_t lo = t * slice < count ? t * slice : count;
+        const size_t hi = lo + slice < count ? lo + slice : count;
+        tasks[t] = (PartitionTask){nodes + lo, hi - lo, buckets + lo, offsets + t * threads, partitioned,
+                                   splitters, threads - 1, comparator, NULL, NULL};
+    }
+    run_partition_tasks(tasks, threads, classify_partition_slice);
+    size_t partitionStart[threads + 1];
+    size_t position = 0;
+    for (size_t p = 0; p < threads; p++) {
+        partitionStart[p] = position;
+        for (size_t t = 0; t < threads; t++) {
+            const size_t sliceCount = tasks[t].offsets[p];
+            tasks[t].offsets[p] = position;
+            position += sliceCount;
+        }
+    }
+    partitionStart[threads] = position;
+    run_partition_tasks(tasks, threads, scatter_partition_slice);
 
-    // Ensure the name fits into the static array
-    if (length > sizeof(fileInfo->name)) {
-        length = sizeof(fileInfo->name) - 1; // Reserve space for the null terminator
+    // Sort and build every partition on its own thread
+    for (size_t p = 0; p < threads; p++) {
+        tasks[p].nodes = partitioned + partitionStart[p];
+        tasks[p].count = partitionStart[p + 1] - partitionStart[p];
+    }
+    run_partition_tasks(tasks, threads, build_partition_tree);
+    memcpy(nodes, partitioned, count * sizeof(Node *)); // Callers get the nodes back in sorted order
+    Node *root = NULL;
+    for (size_t p = 0; p < threads; p++) {
+        if (tasks[p].separator) {
+            root = join_trees(root, tasks[p].separator, tasks[p].root);
+        }
     }
-    memcpy(fileInfo->name, buffer + offset, length);
-    fileInfo->name[length] = '\0'; // Ensure null-terminated
-    offset += length;
+    free(sample);
+    free(buckets);
+    free(partitioned);
+    free(offsets);
+    free(tasks);
+    return root;
+}
+
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78), the checksum of serialized indexes
+#define CRC32C_POLYNOMIAL 0x82F63B78u
 
-    // Deserialize size
-    memcpy(&fileInfo->size, buffer + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+static uint32_t crc32cTable[256];
+static pthread_once_t crc32cTableOnce = PTHREAD_ONCE_INIT;
 
-    // Deserialize path
-    memcpy(&length, buffer + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? crc >> 1 ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        crc32cTable[i] = crc;
+    }
+}
 
-    if (length > sizeof(fileInfo->path)) {
-        length = sizeof(fileInfo->path) - 1; // Reserve space for the null terminator
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *data, size_t length) {
+    pthread_once(&crc32cTableOnce, crc32c_init_table);
+    while (length--) {
+        crc = crc >> 8 ^ crc32cTable[(crc ^ *data++) & 0xFF];
     }
-    memcpy(fileInfo->path, buffer + offset, length);
-    fileInfo->path[length] = '\0'; // Ensure null-terminated
-    offset += length;
+    return crc;
+}
 
-    // Deserialize type
-    memcpy(&length, buffer + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+#if defined(__x86_64__)
+// The SSE4.2 crc32 instruction folds in 8 bytes per cycle; built for it whatever the -m flags, used if the CPU has it
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length) {
+    for (; length && ((uintptr_t) data & 7); length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    uint64_t wide = crc;
+    for (; length >= 8; length -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t) wide;
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
 
-    if (length > sizeof(fileInfo->type)) {
-        length = sizeof(fileInfo->type) - 1; // Reserve space for the null terminator
+/**
+ * Extends the CRC32C `crc` of some bytes with `length` more; start from 0. Chained calls give the
+ * checksum of the concatenation, so large sections can be checksummed piece by piece.
+ */
+uint32_t crc32c(const uint32_t crc, const void *data, const size_t length) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~crc32c_sse42(~crc, data, length);
     }
-    memcpy(fileInfo->type, buffer + offset, length);
-    fileInfo->type[length] = '\0'; // Ensure null-terminated
-    offset += length;
+#endif
+    return ~crc32c_software(~crc, data, length);
+}
+
+// Serializing and Deserializing implementations
+
+// Write the PackedNode record for fileInfo (child links and color are left zero); returns the padded record size
+size_t serialize_file_info(const FileInfo *fileInfo, char *buffer) {
+    PackedNode *packed = (PackedNode *) buffer;
+    const size_t pathLength = strlen(fileInfo->path);
+    const size_t linkTargetLength = fileInfo->linkTarget ? strlen(fileInfo->linkTarget) : 0;
+    const size_t recordSize = calc_file_info_size(fileInfo);
+
+    memset(packed, 0, offsetof(PackedNode, strings));
+    packed->size = fileInfo->size;
+    packed->childrenCount = fileInfo->childrenCount;
+    packed->pathLength = (uint32_t) pathLength;
+    packed->nameOffset = fileInfo->name >= fileInfo->path && fileInfo->name <= fileInfo->path + pathLength
+                             ? (uint32_t) (fileInfo->name - fileInfo->path)
+                             : (uint32_t) pathLength;
+    packed->linkTargetLength = (uint32_t) linkTargetLength;
+    packed->isHidden = fileInfo->isHidden;
+    packed->isDir = fileInfo->isDir;
+    packed->isLink = (uint8_t) fileInfo->isLink;
+    packed->type = fileInfo->type;
+    packed->hash = fileInfo->hash;
+
+    char *strings = packed->strings;
+    memcpy(strings, fileInfo->path, pathLength + 1);
+    strings += pathLength + 1;
+    if (linkTargetLength) {
+        memcpy(strings, fileInfo->linkTarget, linkTargetLength + 1);
+        strings += linkTargetLength + 1;
+    }
+    // Zero the alignment padding so identical trees serialize to identical bytes
+    memset(strings, 0, buffer + recordSize - strings);
+
+    return recordSize;
+}
 
-    memcpy(&length, buffer + offset, sizeof(size_t));
-    offset += sizeof(size_t);
-    memcpy(fileInfo->hash, buffer + offset, length);
-    fileInfo->hash[length] = '\0'; // Ensure null-termination
-    offset += length;
+// Rebuild a FileInfo from a packed record; strings are copied into the calling thread's string pool
+void deserialize_file_info(FileInfo *fileInfo, const PackedNode *packed) {
+    StringPool *pool = string_pool_current();
+    FileInfo view;
+    packed_file_info(packed, &view);
 
-    return offset;
+    *fileInfo = view;
+    fileInfo->path = string_pool_store(pool, view.path, packed->pathLength);
+    fileInfo->name = fileInfo->path + packed->nameOffset;
+    fileInfo->linkTarget = view.linkTarget ? string_pool_store(pool, view.linkTarget, packed->linkTargetLength) : NULL;
 }
 
-void write_tree_to_shared_memory(Node *finalRoot, const char *filePath, const char *prefix) {
+// Name of the shared memory object a tree built from filePath is published under
+static char *shared_memory_name(const char *filePath, const char *prefix) {
     // Extract file name from the file path
     char *fileName = get_filename_from_path(filePath);
     // Allocate memory for the full shared memory name
@@ -312,116 +1108,223 @@ void write_tree_to_shared_memory(Node *finalRoot, const char *filePath, const ch
     char *sharedMemoryName = malloc(sharedMemoryNameLength);
     if (!sharedMemoryName) {
         perror("Failed to allocate memory for shared memory name");
-        free(fileName);
-        return;
+        exit(EXIT_FAILURE);
     }
     // Construct the shared memory name
     snprintf(sharedMemoryName, sharedMemoryNameLength, "%s%s%s%s", prefix, fileName, EXTENSION_RBT, EXTENSION_MEM);
-    // Calculate the size needed for serialization
-    const long long requiredSize = calc_tree_size(finalRoot);
+    free(fileName);
+    return sharedMemoryName;
+}
 
-    // Align size to system page size
-    const long pageSize = sysconf(_SC_PAGE_SIZE);
-    if (pageSize <= 0) {
-        perror("Failed to get page size");
+void write_tree_to_shared_memory(Node *finalRoot, const IndexKey key, const char *filePath, const char *prefix) {
+    char *sharedMemoryName = shared_memory_name(filePath, prefix);
+    write_tree_to_named_shared_memory(finalRoot, key, sharedMemoryName);
+    free(sharedMemoryName);
+}
+
+// Name of the segment a new version of sharedMemoryName is built in, so readers never map a partial one
+static char *shared_memory_temp_name(const char *sharedMemoryName) {
+    const size_t length = strlen(sharedMemoryName) + strlen(".tmp") + 1;
+    char *tempName = malloc(length);
+    if (!tempName) {
+        perror("Failed to allocate memory for shared memory name");
         exit(EXIT_FAILURE);
     }
+    snprintf(tempName, length, "%s.tmp", sharedMemoryName);
+    return tempName;
+}
 
-    const long long alignedSize = ((requiredSize + pageSize - 1) / pageSize) * pageSize; // Align to page size
-
-    // Create buffer for serialized tree (ensure it's still aligned)
-    char *buffer = aligned_alloc(pageSize, alignedSize);
-    if (buffer == NULL) {
-        perror("Failed to allocate aligned buffer");
+// Renames the finished segment tempName over sharedMemoryName; processes that mapped the old one keep it
+static void shared_memory_publish(const char *tempName, const char *sharedMemoryName) {
+    char from[PATH_MAX], to[PATH_MAX];
+    // POSIX shared memory objects are files in /dev/shm, named without their leading '/'
+    snprintf(from, sizeof(from), "/dev/shm/%s", tempName + (tempName[0] == '/'));
+    snprintf(to, sizeof(to), "/dev/shm/%s", sharedMemoryName + (sharedMemoryName[0] == '/'));
+    if (rename(from, to) == -1) {
+        perror("Error: Failed to replace shared memory object");
+        shm_unlink(tempName);
         exit(EXIT_FAILURE);
     }
+}
 
-    // Serialize the tree into the buffer
-    const long long usedSize = serialize_node(finalRoot, buffer);
-
-    if (usedSize > alignedSize) {
-        fprintf(stderr, "Serialized size exceeds aligned size!\n");
-        free(buffer);
+// Serializes source into the shared memory object sharedMemoryName, replacing its contents
+static void write_serialized_to_shared_memory(const char *sharedMemoryName, const char *what,
+                                              uint64_t (*serializer)(const void *, TreeWriter *),
+                                              const void *source) {
+    // Align size to system page size
+    const long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pageSize <= 0) {
+        perror("Failed to get page size");
         exit(EXIT_FAILURE);
     }
 
-    // Create shared memory
-    const int shm_fd = shm_open(sharedMemoryName, O_CREAT | O_RDWR, 0666); // Read-write permissions
+    // Build the tree in a segment of its own; a stale one left by an interrupted run is dropped
+    char *tempName = shared_memory_temp_name(sharedMemoryName);
+    const int shm_fd = shm_open(tempName, O_CREAT | O_RDWR | O_TRUNC, 0666); // Read-write permissions
     if (shm_fd == -1) {
         perror("Failed to create shared memory object");
-        free(buffer);
         exit(EXIT_FAILURE);
     }
 
-    // Set the size of shared memory to the aligned size
-    if (ftruncate(shm_fd, (long long) alignedSize) == -1) {
-        perror("Failed to set shared memory size");
-        free(buffer);
-        close(shm_fd);
-        exit(EXIT_FAILURE);
+    // Serialize straight into the mapping, which grows with the tree
+    TreeWriter writer;
+    tree_writer_init_shared_memory(&writer, shm_fd, 0);
+    const long long usedSize = (long long) serializer(source, &writer);
+    const long long alignedSize = ((usedSize + pageSize - 1) / pageSize) * pageSize; // Align to page size
+    // Zero the tail of the last page, then give back the unused part of the mapping
+    memset(writer.buffer + usedSize, 0, alignedSize - usedSize);
+    if (munmap(writer.buffer, writer.capacity) == -1) {
+        perror("Failed to unmap shared memory");
     }
-
-    // Map shared memory to process space
-    void *ptr = mmap(0, alignedSize, PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (ptr == MAP_FAILED) {
-        perror("Failed to map shared memory");
-        free(buffer);
+    if (ftruncate(shm_fd, (off_t) alignedSize) == -1) {
+        perror("Failed to set shared memory size");
         close(shm_fd);
+        shm_unlink(tempName);
         exit(EXIT_FAILURE);
     }
+    close(shm_fd);
+    // Readers of the old tree keep their mapping; new ones open the complete segment
+    shared_memory_publish(tempName, sharedMemoryName);
+    free(tempName);
 
-    // Copy serialized tree to shared memory
-    memcpy(ptr, buffer, usedSize);
+    char *sizeStr = getFileSizeAsString(usedSize);
 
-    // Cleanup
-    if (munmap(ptr, alignedSize) == -1) {
-        perror("Failed to unmap shared memory");
+    const long long fileSize = getSharedMemorySize(sharedMemoryName);
+    char *memSizeStr = getFileSizeAsString(fileSize);
+
+    printf("%s written to shared memory, rbt size: %s (%lld bytes), file %s size: %s (%lld bytes)\n",
+           what, sizeStr, usedSize, sharedMemoryName, memSizeStr, fileSize);
+    free(memSizeStr);
+    free(sizeStr);
+}
+
+// Serializes source into filename through a fixed-size buffer; the header is patched in at the end
+static void write_serialized_to_file(const char *filename, const char *what,
+                                     uint64_t (*serializer)(const void *, TreeWriter *), const void *source) {
+    // Open the file for writing in binary mode
+    const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        perror("Error: Failed to open file for writing");
+        exit(EXIT_FAILURE);
     }
-    close(shm_fd);
-    free(buffer);
+    // The file is written front to back once and not read back by this process
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    TreeWriter writer;
+    tree_writer_init_file(&writer, fd, 0);
+    const size_t usedSize = serializer(source, &writer);
+    tree_writer_free(&writer);
 
+    if (close(fd) == -1) {
+        perror("Error: Failed to write serialized data to file");
+        exit(EXIT_FAILURE);
+    }
     char *sizeStr = getFileSizeAsString(usedSize);
+    printf("%s successfully written to file '%s', size: %s (%zu bytes)\n", what, filename, sizeStr, usedSize);
+    free(sizeStr); // Free after use
+}
 
-    const long long fileSize = getSharedMemorySize(sharedMemoryName);
-    char *memSizeStr = getFileSizeAsString(fileSize);
+// A red-black tree to serialize and the key its nodes are ordered by
+typedef struct TreeSource {
+    const Node *root;
+    IndexKey key;
+} TreeSource;
 
-    printf("Red-black tree written to shared memory, rbt size: %s (%lld bytes), file %s size: %s (%lld bytes)\n",
-           sizeStr, usedSize, sharedMemoryName, memSizeStr, fileSize);
-    free(fileName);
-    free(memSizeStr);
+static uint64_t serialize_tree_source(const void *source, TreeWriter *writer) {
+    const TreeSource *tree = source;
+    return serialize_tree(tree->root, tree->key, writer);
+}
+
+static uint64_t serialize_eytzinger_source(const void *source, TreeWriter *writer) {
+    return serialize_eytzinger(source, writer);
+}
+
+// Serialize the tree into the shared memory object sharedMemoryName, replacing its contents
+void write_tree_to_named_shared_memory(Node *finalRoot, const IndexKey key, const char *sharedMemoryName) {
+    const TreeSource source = {finalRoot, key};
+    write_serialized_to_shared_memory(sharedMemoryName, "Red-black tree", serialize_tree_source, &source);
+}
+
+void write_eytzinger_to_shared_memory(const EytzingerSource *source, const char *filePath, const char *prefix) {
+    char *sharedMemoryName = shared_memory_name(filePath, prefix);
+    write_serialized_to_shared_memory(sharedMemoryName, "Eytzinger index", serialize_eytzinger_source, source);
     free(sharedMemoryName);
-    free(sizeStr);
+}
+
+void write_eytzinger_to_file(const EytzingerSource *source, const char *filename) {
+    write_serialized_to_file(filename, "Eytzinger index", serialize_eytzinger_source, source);
 }
 
 Node *parent(const Node *n) {
     return n ? n->parent : NULL;
 }
 
-// Function to calculate the serialized size of a single FileInfo
+// Function to calculate the serialized size of a single FileInfo, padding included
 size_t calc_file_info_size(const FileInfo *fileInfo) {
-    return sizeof(size_t) + (strlen(fileInfo->name) + 1) +
-           sizeof(size_t) +
-           sizeof(size_t) + (strlen(fileInfo->path) + 1) +
-           sizeof(size_t) + (strlen(fileInfo->type) + 1) +
-           sizeof(size_t) + (strlen(fileInfo->hash) + 1);
+    return PACKED_ALIGN(offsetof(PackedNode, strings) +
+                        strlen(fileInfo->path) + 1 +
+                        (fileInfo->linkTarget ? strlen(fileInfo->linkTarget) + 1 : 0));
 }
 
-// Function to calculate serialized size of the whole tree
-long long calc_tree_size(const Node *node) {
-    if (node == NULL) {
-        return 0;
+// Leftmost node of a subtree: the first node of its in-order walk
+static const Node *leftmost(const Node *node) {
+    while (node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+// First node of a post-order walk of the subtree: descend left when possible, otherwise right
+static const Node *postorder_leaf(const Node *node) {
+    for (;;) {
+        if (node->left) {
+            node = node->left;
+        } else if (node->right) {
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+}
+
+const Node *tree_inorder_first(const Node *root) {
+    return root ? leftmost(root) : NULL;
+}
+
+// In-order successor of node within the tree rooted at root, NULL after the last node
+const Node *tree_inorder_next(const Node *root, const Node *node) {
+    if (node->right) {
+        return leftmost(node->right);
+    }
+    while (node != root && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node == root ? NULL : node->parent;
+}
+
+const Node *tree_postorder_first(const Node *root) {
+    return root ? postorder_leaf(root) : NULL;
+}
+
+// Post-order successor of node within the tree rooted at root, NULL once root has been visited
+const Node *tree_postorder_next(const Node *root, const Node *node) {
+    if (node == root) {
+        return NULL;
+    }
+    const Node *parent = node->parent;
+    if (node == parent->left && parent->right) {
+        return postorder_leaf(parent->right);
     }
-    const size_t size = calc_file_info_size(&node->key) + sizeof(NodeColor) + 2 * sizeof(int);
-    return size + calc_tree_size(node->left) + calc_tree_size(node->right);
+    return parent;
 }
 
 void inorder(const Node *node) {
-    if (node != NULL) {
-        inorder(node->left);
+    char hash[HASH_HEX_LENGTH];
+    for (const Node *current = tree_inorder_first(node); current; current = tree_inorder_next(node, current)) {
+        hash_to_hex(current->key.hash, hash);
         printf("Filename: %s, Size: %zu bytes, Path: %s, Type: %s, Hash: %s\n",
-               node->key.name, node->key.size, node->key.path,
-               node->key.type, node->key.hash);
-        inorder(node->right);
+               current->key.name, current->key.size, current->key.path,
+               FILE_TYPES[current->key.type], hash);
     }
 }
 
@@ -451,82 +1354,335 @@ char *add_rbt_extension(const char *filename) {
     return newFilename;
 }
 
-void write_tree_to_file(Node *finalRoot, const char *filename) {
-    // Calculate the size needed for serialization
-    const size_t requiredSize = calc_tree_size(finalRoot);
+void write_tree_to_file(Node *finalRoot, const IndexKey key, const char *filename) {
+    const TreeSource source = {finalRoot, key};
+    write_serialized_to_file(filename, "Red-black tree", serialize_tree_source, &source);
+}
 
-    // Open the file for writing in binary mode
-    FILE *file = fopen(filename, "wb");
-    if (!file) {
-        perror("Error: Failed to open file for writing");
+// Initial staging capacity of an in-memory writer that was not given a size hint
+#define TREE_WRITER_DEFAULT_CAPACITY (1024 * 1024)
+// Staging capacity of a file writer; records larger than this grow the buffer just enough to fit
+#define TREE_WRITER_FILE_CAPACITY (8 * 1024 * 1024)
+// Initial size of a shared memory segment being serialized into; it doubles whenever it fills up
+#define TREE_WRITER_SHARED_MEMORY_CAPACITY (64 * 1024 * 1024)
+
+// In-memory writer: the buffer grows as needed and ends up holding the whole serialized tree
+void tree_writer_init_memory(TreeWriter *writer, const size_t capacity) {
+    memset(writer, 0, sizeof(TreeWriter));
+    writer->capacity = capacity ? capacity : TREE_WRITER_DEFAULT_CAPACITY;
+    writer->buffer = malloc(writer->capacity);
+    if (!writer->buffer) {
+        perror("Failed to allocate serialization buffer");
         exit(EXIT_FAILURE);
     }
+}
 
-    // Create a buffer to hold the serialized tree data
-    char *buffer = malloc(requiredSize);
-    if (!buffer) {
-        perror("Error: Failed to allocate memory for serialization buffer");
-        fclose(file);
-        exit(EXIT_FAILURE);
+void tree_writer_free(TreeWriter *writer) {
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+}
+
+// Write the staged bytes to the end of the file
+static bool tree_writer_flush_file(TreeWriter *writer) {
+    const int fd = writer->fd;
+    const char *data = writer->buffer;
+    size_t remaining = writer->length;
+    while (remaining) {
+        const ssize_t written = write(fd, data, remaining);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error: Failed to write serialized data to file");
+            return false;
+        }
+        data += written;
+        remaining -= written;
+    }
+    // Keep the page cache bounded while a large index is written. Dirty pages cannot be dropped, so
+    // writeback of this window is started now, and the windows before it (started on earlier flushes)
+    // are waited for and dropped, one window behind the writes.
+    sync_file_range(fd, (off_t) writer->flushed, (off_t) writer->length, SYNC_FILE_RANGE_WRITE);
+    if (writer->released < writer->flushed) {
+        const off_t offset = (off_t) writer->released;
+        const off_t length = (off_t) (writer->flushed - writer->released);
+        sync_file_range(fd, offset, length,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        writer->released = writer->flushed;
+    }
+    return true;
+}
+
+// Overwrite bytes that were already flushed, used for the header once the tree is complete
+static bool tree_writer_patch_file(TreeWriter *writer, const uint64_t offset, const void *data, const size_t length) {
+    const int fd = writer->fd;
+    if (pwrite(fd, data, length, (off_t) offset) != (ssize_t) length) {
+        perror("Error: Failed to write serialized tree header");
+        return false;
     }
+    return true;
+}
 
-    // Serialize the tree into the buffer
-    const size_t usedSize = serialize_node(finalRoot, buffer);
+// File writer: records are staged in a buffer of fixed capacity and flushed to fd whenever it fills up
+void tree_writer_init_file(TreeWriter *writer, const int fd, const size_t capacity) {
+    tree_writer_init_memory(writer, capacity ? capacity : TREE_WRITER_FILE_CAPACITY);
+    writer->fd = fd;
+    writer->flush = tree_writer_flush_file;
+    writer->patch = tree_writer_patch_file;
+}
 
-    // Ensure the serialized size does not exceed the calculated size
-    if (usedSize > requiredSize) {
-        fprintf(stderr, "Error: Serialized size (%zu bytes) exceeds expected size (%zu bytes)!\n", usedSize,
-                requiredSize);
-        free(buffer);
-        fclose(file);
-        exit(EXIT_FAILURE);
+// Extend the segment and its mapping; mremap may move the mapping, which is fine as nothing keeps pointers into it
+static bool tree_writer_grow_shared_memory(TreeWriter *writer, const size_t capacity) {
+    if (ftruncate(writer->fd, (off_t) capacity) == -1) {
+        perror("Failed to grow shared memory");
+        return false;
     }
+    void *buffer = mremap(writer->buffer, writer->capacity, capacity, MREMAP_MAYMOVE);
+    if (buffer == MAP_FAILED) {
+        perror("Failed to remap shared memory");
+        return false;
+    }
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    return true;
+}
 
-    // Write the serialized data to the file
-    if (fwrite(buffer, 1, usedSize, file) != usedSize) {
-        perror("Error: Failed to write serialized data to file");
-        free(buffer);
-        fclose(file);
+/**
+ * Shared memory writer: records are written straight into a mapping of the segment behind fd,
+ * which is grown as needed. The caller unmaps writer->buffer (writer->capacity bytes) when done.
+ */
+void tree_writer_init_shared_memory(TreeWriter *writer, const int fd, const size_t capacity) {
+    memset(writer, 0, sizeof(TreeWriter));
+    writer->fd = fd;
+    writer->capacity = capacity ? capacity : TREE_WRITER_SHARED_MEMORY_CAPACITY;
+    if (ftruncate(fd, (off_t) writer->capacity) == -1) {
+        perror("Failed to set shared memory size");
         exit(EXIT_FAILURE);
     }
+    writer->buffer = mmap(NULL, writer->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (writer->buffer == MAP_FAILED) {
+        perror("Failed to map shared memory");
+        exit(EXIT_FAILURE);
+    }
+    writer->grow = tree_writer_grow_shared_memory;
+}
 
-    // Cleanup resources
-    free(buffer);
-    fclose(file);
-    char *sizeStr = getFileSizeAsString(usedSize);
-    printf("Red-black tree successfully written to file '%s', size: %s (%zu bytes)\n", filename, sizeStr, usedSize);
-    free(sizeStr); // Free after use
+// Fold the staged bytes that follow the header and were not checksummed yet into the running CRC32C
+static void tree_writer_checksum(TreeWriter *writer) {
+    const uint64_t end = writer->flushed + writer->length;
+    const uint64_t start = writer->checksummed > sizeof(IndexHeader) ? writer->checksummed : sizeof(IndexHeader);
+    if (end > start) {
+        writer->crc = crc32c(writer->crc, writer->buffer + (start - writer->flushed), end - start);
+        writer->checksummed = end;
+    }
 }
 
-// Function to serialize a single node
-long long serialize_node(Node *node, char *buffer) {
-    if (node == NULL) {
-        return 0;
+// Make room for `size` more staged bytes, flushing the buffer or growing it; returns where they go
+static char *tree_writer_reserve(TreeWriter *writer, const size_t size) {
+    if (writer->length + size <= writer->capacity) {
+        return writer->buffer + writer->length;
+    }
+    if (writer->flush && writer->length) {
+        // Staged records are complete, and flushed ones are gone from the buffer
+        tree_writer_checksum(writer);
+        if (!writer->flush(writer)) {
+            fprintf(stderr, "Error: Failed to flush serialized tree.\n");
+            exit(EXIT_FAILURE);
+        }
+        writer->flushed += writer->length;
+        writer->length = 0;
+    }
+    if (writer->length + size > writer->capacity) {
+        size_t capacity = writer->capacity;
+        while (writer->length + size > capacity) {
+            capacity *= RESIZE_FACTOR;
+        }
+        if (writer->grow) {
+            if (!writer->grow(writer, capacity)) {
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            char *buffer = realloc(writer->buffer, capacity);
+            if (!buffer) {
+                perror("Failed to grow serialization buffer");
+                exit(EXIT_FAILURE);
+            }
+            writer->buffer = buffer;
+            writer->capacity = capacity;
+        }
     }
+    return writer->buffer + writer->length;
+}
+
+// Absolute offset the next staged byte will end up at
+static uint64_t tree_writer_offset(const TreeWriter *writer) {
+    return writer->flushed + writer->length;
+}
 
-    size_t offset = 0;
-    offset += serialize_file_info(&node->key, buffer);
+/**
+ * Appends the record of a single node whose children, if any, were already written at
+ * leftOffset and rightOffset. Returns the absolute offset of the new record.
+ */
+uint64_t serialize_node(const Node *node, TreeWriter *writer, const uint64_t leftOffset, const uint64_t rightOffset) {
+    const uint64_t self = tree_writer_offset(writer);
+    char *record = tree_writer_reserve(writer, calc_file_info_size(&node->key));
+    PackedNode *packed = (PackedNode *) record;
+    writer->length += serialize_file_info(&node->key, record);
+    packed->left = leftOffset ? self - leftOffset : 0;
+    packed->right = rightOffset ? self - rightOffset : 0;
+    packed->color = (uint8_t) node->color;
+    packed->count = node->count;
+    packed->sum = node->sum;
+
+    return self;
+}
 
-    memcpy(buffer + offset, &node->color, sizeof(NodeColor));
-    offset += sizeof(NodeColor);
+// Append length bytes to the writer
+static void tree_writer_append(TreeWriter *writer, const void *data, const size_t length) {
+    memcpy(tree_writer_reserve(writer, length), data, length);
+    writer->length += length;
+}
 
-    // Mark non-null nodes
-    const int hasLeft = node->left != NULL;
-    const int hasRight = node->right != NULL;
-    memcpy(buffer + offset, &hasLeft, sizeof(int));
-    offset += sizeof(int);
-    memcpy(buffer + offset, &hasRight, sizeof(int));
-    offset += sizeof(int);
+// Header of an index being written; the totals, offsets and checksums are filled in as it is finished
+static IndexHeader index_header_template(const IndexLayout layout, const IndexKey key) {
+    IndexHeader header = {0};
+    memcpy(header.magic, RBT_MAGIC, RBT_MAGIC_LENGTH);
+    header.version = RBT_FORMAT_VERSION;
+    header.headerSize = sizeof(IndexHeader);
+    header.layout = layout;
+    header.key = key;
+    header.hashAlgorithm = hashAlgorithm;
+    return header;
+}
+
+/**
+ * Checksums and flushes the rest of the records, then writes the finished header in front of them
+ * (patching it in when the start of the output was already flushed). Returns the bytes used.
+ */
+static uint64_t tree_writer_finish(TreeWriter *writer, IndexHeader *header) {
+    tree_writer_checksum(writer);
+    header->used = tree_writer_offset(writer);
+    header->dataCrc = writer->crc;
+    header->headerCrc = crc32c(0, header, offsetof(IndexHeader, headerCrc));
+    if (writer->patch) {
+        if ((writer->flush && writer->length && !writer->flush(writer)) ||
+            !writer->patch(writer, 0, header, sizeof(IndexHeader))) {
+            fprintf(stderr, "Error: Failed to finish serialized index.\n");
+            exit(EXIT_FAILURE);
+        }
+        writer->flushed += writer->length;
+        writer->length = 0;
+    } else {
+        memcpy(writer->buffer, header, sizeof(IndexHeader));
+    }
+    return header->used;
+}
 
-    // Serialize child nodes (left and right)
-    if (node->left) {
-        offset += serialize_node(node->left, buffer + offset);
+/**
+ * Serializes the header and the whole tree in a single post-order pass. Records are streamed
+ * through the writer as they are produced; the offsets of finished subtrees wait on a small
+ * explicit stack (its depth is bounded by the tree height) until their parent is written.
+ * The header goes in last, once the root offset and the totals are known. Returns the bytes used.
+ */
+uint64_t serialize_tree(const Node *root, const IndexKey key, TreeWriter *writer) {
+    IndexHeader header = index_header_template(INDEX_LAYOUT_TREE, key);
+    tree_writer_append(writer, &header, sizeof(IndexHeader));
+
+    size_t depth = 0;
+    size_t capacity = 64;
+    uint64_t *pending = malloc(capacity * sizeof(uint64_t));
+    if (!pending) {
+        perror("Failed to allocate serialization stack");
+        exit(EXIT_FAILURE);
     }
-    if (node->right) {
-        offset += serialize_node(node->right, buffer + offset);
+
+    for (const Node *node = tree_postorder_first(root); node; node = tree_postorder_next(root, node)) {
+        // The right subtree finished last, so its root sits on top of the left one's
+        const uint64_t rightOffset = node->right ? pending[--depth] : 0;
+        const uint64_t leftOffset = node->left ? pending[--depth] : 0;
+        if (depth == capacity) {
+            capacity *= RESIZE_FACTOR;
+            uint64_t *grown = realloc(pending, capacity * sizeof(uint64_t));
+            if (!grown) {
+                perror("Failed to grow serialization stack");
+                free(pending);
+                exit(EXIT_FAILURE);
+            }
+            pending = grown;
+        }
+        pending[depth++] = serialize_node(node, writer, leftOffset, rightOffset);
+        header.count++;
     }
+    header.root = depth ? pending[0] : 0;
+    free(pending);
+
+    return tree_writer_finish(writer, &header);
+}
 
-    return offset;
+/**
+ * Serializes sorted nodes in the Eytzinger layout: the records in key order, then the key, rank and
+ * record offset tables, then the header. The key table starts on a cache line boundary so that the
+ * eight keys a search prefetches three levels ahead share one line.
+ */
+uint64_t serialize_eytzinger(const EytzingerSource *source, TreeWriter *writer) {
+    const size_t count = source->count;
+    IndexHeader header = index_header_template(INDEX_LAYOUT_EYTZINGER, source->key);
+    header.count = count;
+    tree_writer_append(writer, &header, sizeof(IndexHeader));
+
+    uint64_t *offsets = malloc((count + 1) * sizeof(uint64_t));
+    uint64_t *ranks = malloc((count + 1) * sizeof(uint64_t));
+    if (!offsets || !ranks) {
+        perror("Failed to allocate Eytzinger tables");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const FileInfo *key = &source->nodes[i]->key;
+        offsets[i] = tree_writer_offset(writer);
+        char *record = tree_writer_reserve(writer, calc_file_info_size(key));
+        PackedNode *packed = (PackedNode *) record;
+        writer->length += serialize_file_info(key, record);
+        packed->color = BLACK;
+        packed->count = 1;
+        packed->sum = key->size;
+    }
+
+    // An in-order walk of the implicit tree (children of slot k at 2k and 2k + 1) visits the slots in key order
+    ranks[0] = 0;
+    size_t k = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0) {
+            while (2 * k <= count) k *= 2;
+        } else if (2 * k + 1 <= count) {
+            k = 2 * k + 1;
+            while (2 * k <= count) k *= 2;
+        } else {
+            while (k & 1) k >>= 1; // Climb while coming from a right child
+            k >>= 1;
+        }
+        ranks[k] = i;
+    }
+
+    static const char padding[64] = {0};
+    tree_writer_append(writer, padding, (64 - tree_writer_offset(writer) % 64) % 64);
+    header.keys = tree_writer_offset(writer);
+    const uint64_t unused = 0;
+    tree_writer_append(writer, &unused, sizeof(uint64_t));
+    for (size_t slot = 1; slot <= count; slot++) {
+        const uint64_t value = eytzinger_key(&source->nodes[ranks[slot]]->key, source->key);
+        tree_writer_append(writer, &value, sizeof(uint64_t));
+    }
+    header.ranks = tree_writer_offset(writer);
+    tree_writer_append(writer, ranks, (count + 1) * sizeof(uint64_t));
+    header.records = tree_writer_offset(writer);
+    tree_writer_append(writer, offsets, count * sizeof(uint64_t));
+    free(ranks);
+    free(offsets);
+
+    return tree_writer_finish(writer, &header);
 }
 
 void read_tree_from_file_to_shared_memory(char *filePath, const char *prefix) {
@@ -555,79 +1711,94 @@ void read_tree_from_file_to_shared_memory(char *filePath, const char *prefix) {
                  EXTENSION_MEM); // Append .rbt
     }
 
-    FILE *file = fopen(filePath, "rb");
-    if (!file) {
+    const int fd = open(filePath, O_RDONLY);
+    if (fd == -1) {
         perror("Error: Failed to open file for reading");
         exit(EXIT_FAILURE);
     }
 
     // Determine the size of the serialized data
-    fseek(file, 0, SEEK_END);
-    const size_t fileSize = ftell(file); // Total size of the file
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1) {
+        perror("Error: Failed to stat file");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    const size_t fileSize = fileStat.st_size; // Total size of the file
     if (fileSize == 0) {
         fprintf(stderr, "Error: File is empty.\n");
-        fclose(file);
+        close(fd);
         exit(EXIT_FAILURE);
     }
-    rewind(file);
 
     printf("Reading serialized data from file '%s', size: %zu bytes\n", filePath, fileSize);
 
-    // Allocate a buffer to hold the serialized data
-    char *buffer = malloc(fileSize);
-    if (!buffer) {
-        perror("Error: Failed to allocate memory for serialized data buffer");
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
-
-    // Read the serialized data into the buffer
-    if (fread(buffer, 1, fileSize, file) != fileSize) {
-        perror("Error: Failed to read serialized data from file");
-        free(buffer);
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
-
-    fclose(file); // File read is complete
+    // Refuse to publish anything that is not a serialized index; the header alone tells
+    IndexHeader header = {0};
+    const ssize_t headerLength = pread(fd, &header, sizeof(header), 0);
+    index_header((const char *) &header, headerLength == (ssize_t) sizeof(header) ? fileSize : 0);
 
-    // Set up shared memory
-    const int shm_fd = shm_open(sharedMemoryName, O_CREAT | O_RDWR, 0666); // Open shared memory
+    // Copy into a segment of its own and rename it into place once checked, so a published index is never
+    // truncated under a reader or replaced by a damaged one
+    char *tempName = shared_memory_temp_name(sharedMemoryName);
+    const int shm_fd = shm_open(tempName, O_CREAT | O_RDWR | O_TRUNC, 0666); // Open shared memory
     if (shm_fd == -1) {
         perror("Error: Failed to create shared memory object");
-        free(buffer);
+        close(fd);
         exit(EXIT_FAILURE);
     }
 
     // Resize the shared memory to hold the serialized data
     if (ftruncate(shm_fd, (long long) fileSize) == -1) {
         perror("Error: Failed to resize shared memory");
-        free(buffer);
+        close(fd);
         close(shm_fd);
-        shm_unlink(sharedMemoryName); // Cleanup the shared memory object
+        shm_unlink(tempName); // Cleanup the shared memory object
         exit(EXIT_FAILURE);
     }
 
-    // Memory map the shared memory object
-    void *sharedMemoryPtr = mmap(0, fileSize, PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (sharedMemoryPtr == MAP_FAILED) {
+    // Let the kernel copy the file into the segment, without a staging buffer in this process
+    off_t offset = 0;
+    while ((size_t) offset < fileSize) {
+        const ssize_t copied = sendfile(shm_fd, fd, &offset, fileSize - offset);
+        if (copied <= 0) {
+            if (copied == -1 && errno == EINTR) {
+                continue;
+            }
+            perror("Error: Failed to copy serialized data into shared memory");
+            close(fd);
+            close(shm_fd);
+            shm_unlink(tempName); // Cleanup the shared memory object
+            exit(EXIT_FAILURE);
+        }
+    }
+    close(fd); // File read is complete
+
+    // Nor anything whose records were damaged on disk: check them against the checksum before readers see them
+    const char *published = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, shm_fd, 0);
+    if (published == MAP_FAILED) {
         perror("Error: Failed to map shared memory");
-        free(buffer);
         close(shm_fd);
-        shm_unlink(sharedMemoryName); // Cleanup the shared memory object
+        shm_unlink(tempName);
+        exit(EXIT_FAILURE);
+    }
+    const bool intact = index_data_intact(index_header(published, fileSize));
+    munmap((void *) published, fileSize);
+    if (!intact) {
+        fprintf(stderr, "Error: Checksum mismatch in '%s', the index is corrupt.\n", filePath);
+        close(shm_fd);
+        shm_unlink(tempName);
         exit(EXIT_FAILURE);
     }
 
-    // Copy serialized data from the buffer into shared memory
-    memcpy(sharedMemoryPtr, buffer, fileSize);
+    shared_memory_publish(tempName, sharedMemoryName);
+    free(tempName);
 
     // Cleanup
     char *sizeStr = getFileSizeAsString(fileSize);
     printf("Serialized red-black tree successfully stored in shared memory %s, size: %s (%zu bytes)\n",
            sharedMemoryName, sizeStr, fileSize);
-    munmap(sharedMemoryPtr, fileSize); // Unmap shared memory
     close(shm_fd); // Close shared memory file descriptor
-    free(buffer); // Free the temporary buffer
     free(fileName);
     free(sharedMemoryName);
     free(sizeStr);
@@ -702,63 +1873,232 @@ int compareByFilesize(const FileInfo *a, const FileInfo *b) {
     return (a->size > b->size) - (a->size < b->size);
 }
 
-// Deserialize a node from the buffer
-Node *deserialize_node(char *buffer, size_t *currentOffset) {
-    Node *node = malloc(sizeof(Node));
-    if (node == NULL) return NULL;
+/**
+ * Validates the header of a serialized index of `length` bytes and returns it. Only the header is read,
+ * so this takes microseconds whatever the index size; index_data_intact checks the records themselves.
+ * Exits if the buffer is not an index written by this version of rbt_create, or is truncated.
+ */
+const IndexHeader *index_header(const char *buffer, const size_t length) {
+    if (length < RBT_MAGIC_LENGTH || memcmp(buffer, RBT_MAGIC, RBT_MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "Error: Not a serialized index, or one from an older rbt_create; rebuild it.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (length < sizeof(IndexHeader)) {
+        fprintf(stderr, "Error: Serialized index is truncated (%zu bytes).\n", length);
+        exit(EXIT_FAILURE);
+    }
+    const IndexHeader *header = (const IndexHeader *) buffer;
+    if (header->version != RBT_FORMAT_VERSION || header->headerSize != sizeof(IndexHeader)) {
+        fprintf(stderr, "Error: Index format version %u, this build reads version %d; rebuild it.\n",
+                header->version, RBT_FORMAT_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    if (crc32c(0, header, offsetof(IndexHeader, headerCrc)) != header->headerCrc) {
+        fprintf(stderr, "Error: Index header is corrupt.\n");
+        exit(EXIT_FAILURE);
+    }
+    bool sectionsFit = header->used >= sizeof(IndexHeader);
+    if (header->layout == INDEX_LAYOUT_TREE) {
+        // The root is the last record written; its children are checked as the tree is walked
+        sectionsFit = sectionsFit && (header->root == 0 ||
+                                      (header->root % 8 == 0 && header->root >= header->headerSize &&
+                                       header->root < header->used &&
+                                       header->used - header->root >= sizeof(PackedNode)));
+    } else {
+        // count < used / 8 keeps (count + 1) * 8 from overflowing
+        const uint64_t table = (header->count + 1) * sizeof(uint64_t);
+        sectionsFit = sectionsFit && header->layout == INDEX_LAYOUT_EYTZINGER &&
+                      header->count < header->used / sizeof(uint64_t) &&
+                      header->keys <= header->used - table &&
+                      header->ranks <= header->used - table &&
+                      header->records <= header->used - table + sizeof(uint64_t);
+    }
+    if (!sectionsFit) {
+        fprintf(stderr, "Error: Index header is corrupt.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (header->used > length) {
+        fprintf(stderr, "Error: Serialized index is truncated (%zu of %llu bytes).\n", length,
+                (unsigned long long) header->used);
+        exit(EXIT_FAILURE);
+    }
+    return header;
+}
+
+// A child offset that no writer produces: the records are damaged, following it would read outside them
+void index_records_corrupt(void) {
+    fprintf(stderr, "Error: Index records are corrupt.\n");
+    exit(EXIT_FAILURE);
+}
 
-    const size_t offset = deserialize_file_info(&node->key, buffer + *currentOffset);
-    *currentOffset += offset;
+// Whether the records of a validated index still match the checksum they were written with; reads them all
+bool index_data_intact(const IndexHeader *header) {
+    return crc32c(0, (const char *) header + header->headerSize, header->used - header->headerSize) ==
+           header->dataCrc;
+}
 
-    memcpy(&node->color, buffer + *currentOffset, sizeof(NodeColor));
-    *currentOffset += sizeof(NodeColor);
+const char *index_key_name(const IndexKey key) {
+    switch (key) {
+        case INDEX_KEY_NAME: return "name";
+        case INDEX_KEY_SIZE: return "size";
+        case INDEX_KEY_PATH: return "path";
+        case INDEX_KEY_HASH: return "hash";
+        default: return "unknown";
+    }
+}
 
-    int hasLeft, hasRight;
-    memcpy(&hasLeft, buffer + *currentOffset, sizeof(int));
-    *currentOffset += sizeof(int);
-    memcpy(&hasRight, buffer + *currentOffset, sizeof(int));
-    *currentOffset += sizeof(int);
+// Key of the indexes published under an rbt_<key>_ prefix
+IndexKey index_key_for_prefix(const char *prefix) {
+    if (strcmp(prefix, "rbt_name_") == 0) return INDEX_KEY_NAME;
+    if (strcmp(prefix, "rbt_size_") == 0) return INDEX_KEY_SIZE;
+    if (strcmp(prefix, "rbt_path_") == 0) return INDEX_KEY_PATH;
+    if (strcmp(prefix, "rbt_hash_") == 0) return INDEX_KEY_HASH;
+    return INDEX_KEY_UNKNOWN;
+}
 
-    if (hasLeft) {
-        node->left = deserialize_node(buffer, currentOffset);
-        node->left->parent = node;
-    } else {
-        node->left = NULL;
+/**
+ * Validates the header of a serialized tree and returns its root record, or NULL for an empty tree.
+ * Exits if the buffer is not a tree index written by this version of rbt_create.
+ */
+const PackedNode *packed_tree_root(const char *buffer, const size_t length) {
+    const IndexHeader *header = index_header(buffer, length);
+    if (header->layout != INDEX_LAYOUT_TREE) {
+        fprintf(stderr, "Error: Expected a red-black tree, got an Eytzinger index.\n");
+        exit(EXIT_FAILURE);
     }
+    return index_tree_root(header);
+}
 
-    if (hasRight) {
-        node->right = deserialize_node(buffer, currentOffset);
-        node->right->parent = node;
-    } else {
+/**
+ * Rebuild a mutable node (and its subtree) from a packed record. The records are visited
+ * pre-order from an explicit stack, so deep trees cannot exhaust the thread stack.
+ */
+Node *deserialize_node(const PackedNode *packed, Node *parent, const char *records) {
+    if (packed == NULL) {
+        return NULL;
+    }
+    typedef struct {
+        const PackedNode *packed;
+        Node *parent;
+        Node **link;
+    } PendingRecord;
+
+    Node *subtree = NULL;
+    size_t depth = 0;
+    size_t capacity = 64;
+    PendingRecord *pending = malloc(capacity * sizeof(PendingRecord));
+    if (!pending) {
+        perror("Failed to allocate deserialization stack");
+        exit(EXIT_FAILURE);
+    }
+    pending[depth++] = (PendingRecord){packed, parent, &subtree};
+
+    NodeArena *arena = node_arena_current();
+    while (depth) {
+        const PendingRecord record = pending[--depth];
+        Node *node = node_arena_alloc(arena);
+        deserialize_file_info(&node->key, record.packed);
+        node->color = record.packed->color == BLACK ? BLACK : RED;
+        node->count = record.packed->count;
+        node->sum = record.packed->sum;
+        node->parent = record.parent;
+        node->left = NULL;
         node->right = NULL;
+        *record.link = node;
+
+        if (depth + 2 > capacity) {
+            capacity *= RESIZE_FACTOR;
+            PendingRecord *grown = realloc(pending, capacity * sizeof(PendingRecord));
+            if (!grown) {
+                perror("Failed to grow deserialization stack");
+                free(pending);
+                exit(EXIT_FAILURE);
+            }
+            pending = grown;
+        }
+        const PackedNode *right = packed_right(record.packed, records);
+        const PackedNode *left = packed_left(record.packed, records);
+        if (right) {
+            pending[depth++] = (PendingRecord){right, node, &node->right};
+        }
+        if (left) {
+            pending[depth++] = (PendingRecord){left, node, &node->left};
+        }
     }
+    free(pending);
 
-    return node;
+    return subtree;
+}
+
+/**
+ * Number of records that order before key (or before or with it when inclusive) in a tree sorted by
+ * comparator; when sum is not NULL it receives the total size of those records. Walks a single
+ * root-to-leaf path, adding up the left subtrees passed by.
+ */
+uint64_t packed_tree_rank(const PackedNode *root, const char *records, const FileInfo *key,
+                          int (*comparator)(const FileInfo *, const FileInfo *), const bool inclusive,
+                          uint64_t *sum) {
+    uint64_t rank = 0;
+    uint64_t total = 0;
+    const PackedNode *node = root;
+    while (node) {
+        FileInfo info;
+        packed_file_info(node, &info);
+        const int cmp = comparator(&info, key);
+        if (cmp < 0 || (inclusive && cmp == 0)) {
+            const PackedNode *left = packed_left(node, records);
+            rank += packed_count(left) + 1;
+            total += packed_sum(left) + node->size;
+            node = packed_right(node, records);
+        } else {
+            node = packed_left(node, records);
+        }
+    }
+    if (sum) {
+        *sum = total;
+    }
+    return rank;
 }
 
-// Recursive function to free allocated nodes
-void freeNode(Node *node) {
-    if (node == NULL) return;
-    freeNode(node->left);
-    freeNode(node->right);
-    free(node->key.name);
+// Record at 0-based position index of the in-order sequence, NULL when the tree is smaller than that
+const PackedNode *packed_tree_select(const PackedNode *root, const char *records, uint64_t index) {
+    const PackedNode *node = root;
+    while (node) {
+        const PackedNode *left = packed_left(node, records);
+        const uint64_t leftCount = packed_count(left);
+        if (index < leftCount) {
+            node = left;
+        } else if (index == leftCount) {
+            return node;
+        } else {
+            index -= leftCount + 1;
+            node = packed_right(node, records);
+        }
+    }
+    return NULL;
+}
+
+// Rebuild a mutable tree from a serialized buffer of `length` bytes; it must start with an IndexHeader
+Node *deserialize_tree(const char *buffer, const size_t length) {
+    const PackedNode *root = packed_tree_root(buffer, length);
+    return deserialize_node(root, NULL, index_records((const IndexHeader *) buffer));
 }
 
 // Function to search and print files with a given size and type
-void search_tree_for_size_and_type(Node *root, size_t targetSize, const char *targetType) {
+void search_tree_for_size_and_type(Node *root, size_t targetSize, const FileType targetType) {
     if (root == NULL) {
         return;
     }
 
-    if (root->key.size == targetSize && strcmp(root->key.type, targetType) == 0) {
-        printf("Found file: %s (Size: %zu, Type: %s)\n", root->key.name, root->key.size, root->key.type);
+    if (root->key.size == targetSize && root->key.type == targetType) {
+        printf("Found file: %s (Size: %zu, Type: %s)\n", root->key.name, root->key.size, FILE_TYPES[root->key.type]);
     }
 
     search_tree_for_size_and_type(root->left, targetSize, targetType);
     search_tree_for_size_and_type(root->right, targetSize, targetType);
 }
 
-void search_tree_for_name_and_type(Node *root, const char *namePattern, const char *targetType) {
+void search_tree_for_name_and_type(Node *root, const char *namePattern, const FileType targetType) {
     if (root == NULL) {
         return;
     }
@@ -774,9 +2114,9 @@ void search_tree_for_name_and_type(Node *root, const char *namePattern, const ch
     }
 
     // Check if the current node matches the name regex and file type
-    if (regexec(&regex, root->key.name, 0, NULL, 0) == 0 && strcmp(root->key.type, targetType) == 0) {
+    if (regexec(&regex, root->key.name, 0, NULL, 0) == 0 && root->key.type == targetType) {
         printf("Found file: %s (Type: %s, Size: %zu, Path: %s)\n",
-               root->key.name, root->key.type, root->key.size, root->key.path);
+               root->key.name, FILE_TYPES[root->key.type], root->key.size, root->key.path);
     }
 
     // Free the regex memory after usage
@@ -812,50 +2152,460 @@ void listSharedMemoryEntities(const char *prefix) {
     closedir(dir);
 }
 
+// Map a file read-only for one front-to-back pass; an empty file leaves base NULL
+static int map_file_readonly(const char *filename, MappedLines *mapped) {
+    *mapped = (MappedLines){0};
+    const int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file");
+        exit(EXIT_FAILURE);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1) {
+        perror("Error getting file size");
+        close(fd);
+        return -1;
+    }
+    mapped->length = fileStat.st_size;
+    if (mapped->length > 0) {
+        mapped->base = mmap(NULL, mapped->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped->base == MAP_FAILED) {
+            perror("Error mapping file");
+            mapped->base = NULL;
+            close(fd);
+            return -1;
+        }
+        madvise(mapped->base, mapped->length, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return 0;
+}
+
+// Next non-empty line at or after *at, advancing *at past it
+static bool next_line_span(const char **at, const char *end, LineSpan *line) {
+    while (*at < end) {
+        const char *newline = memchr(*at, '\n', end - *at);
+        const char *lineEnd = newline ? newline : end;
+        const char *start = *at;
+        *at = lineEnd + 1;
+        if (lineEnd > start) { // Ignore empty lines
+            *line = (LineSpan){start, lineEnd - start};
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
- * Reads lines from a given file and stores them in a dynamically allocated array.
+ * Maps a file read-only and collects the spans of its non-empty lines, which point into the mapping
+ * instead of being copied. The spans stay valid until unmap_file_lines.
  *
  * @param filename The name of the file to read.
- * @param lines A pointer to a dynamically allocated array of strings.
- * @param numLines A pointer to a variable where the number of lines will be stored.
+ * @param mapped Receives the mapping and the line spans.
  * @return 0 on success, -1 on failure.
  */
-int read_file_lines(const char *filename, char ***lines, size_t *numLines) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening file");
+int map_file_lines(const char *filename, MappedLines *mapped) {
+    if (map_file_readonly(filename, mapped) != 0) {
+        return -1;
+    }
+    size_t capacity = 0;
+    const char *at = mapped->base;
+    LineSpan line;
+    while (next_line_span(&at, mapped->base + mapped->length, &line)) {
+        if (mapped->count == capacity) {
+            capacity = capacity ? capacity * RESIZE_FACTOR : INITIAL_CAPACITY;
+            LineSpan *temp = realloc(mapped->lines, capacity * sizeof(LineSpan));
+            if (!temp) {
+                perror("Failed to allocate memory for lines");
+                unmap_file_lines(mapped);
+                return -1;
+            }
+            mapped->lines = temp;
+        }
+        mapped->lines[mapped->count++] = line;
+    }
+    printf("Read %zu lines from file %s \n", mapped->count, filename);
+    return 0;
+}
+
+void unmap_file_lines(MappedLines *mapped) {
+    if (mapped->base) {
+        munmap(mapped->base, mapped->length);
+    }
+    free(mapped->lines);
+    *mapped = (MappedLines){0};
+}
+
+// Slot of a BoundedQueue; its sequence number tells whether it is free to write or ready to read
+typedef struct QueueSlot {
+    _Atomic size_t sequence;
+    void *item;
+} QueueSlot;
+
+// Bounded lock-free multi-producer multi-consumer queue of pointers, after Vyukov's array queue
+typedef struct BoundedQueue {
+    QueueSlot *slots;
+    size_t mask; // Capacity - 1, the capacity being a power of two
+    _Alignas(64) _Atomic size_t head; // Next position to write
+    _Alignas(64) _Atomic size_t tail; // Next position to read
+} BoundedQueue;
+
+static void bounded_queue_init(BoundedQueue *queue, const size_t capacity) {
+    size_t slots = 2;
+    while (slots < capacity) {
+        slots *= 2;
+    }
+    queue->slots = malloc(slots * sizeof(QueueSlot));
+    if (!queue->slots) {
+        perror("Failed to allocate memory for queue");
         exit(EXIT_FAILURE);
     }
+    for (size_t i = 0; i < slots; i++) {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+    queue->mask = slots - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
 
-    char buffer[8 * MAX_LINE_LENGTH];
-    *lines = NULL; // Ensure lines starts as NULL
-    *numLines = 0; // Initialize the line count to 0
+static bool bounded_queue_try_push(BoundedQueue *queue, void *item) {
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;) {
+        QueueSlot *slot = &queue->slots[position & queue->mask];
+        const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                slot->item = item;
+                atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false; // Full
+        } else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+}
 
-    // Reading lines from the file
-    while (fgets(buffer, sizeof(buffer), file)) {
-        remove_trailing_newline(buffer);
-        if (*buffer) { // Ignore empty lines
-            char **temp = realloc(*lines, sizeof(char *) * (*numLines + 1));
-            if (!temp) {
-                perror("Failed to allocate memory for lines");
-                fclose(file);
-                return -1; // Indicate failure
+static bool bounded_queue_try_pop(BoundedQueue *queue, void **item) {
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    for (;;) {
+        QueueSlot *slot = &queue->slots[position & queue->mask];
+        const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *item = slot->item;
+                atomic_store_explicit(&slot->sequence, position + queue->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false; // Empty
+        } else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Blocking variants: a stage waiting on a full or empty queue gives its core to the other stages
+static void bounded_queue_push(BoundedQueue *queue, void *item) {
+    while (!bounded_queue_try_push(queue, item)) {
+        sched_yield();
+    }
+}
+
+static void *bounded_queue_pop(BoundedQueue *queue) {
+    void *item;
+    while (!bounded_queue_try_pop(queue, &item)) {
+        sched_yield();
+    }
+    return item;
+}
+
+// Lines handed from the reader to a worker in one go
+#define PARSE_BATCH_LINES 1024
+// Batches in flight per worker on each queue
+#define PARSE_QUEUE_DEPTH 4
+
+// A run of consecutive listing lines and the records parsed from them
+typedef struct ParseBatch {
+    size_t sequence; // Position of the batch in the listing
+    size_t lineCount;
+    size_t recordCount;
+    LineSpan lines[PARSE_BATCH_LINES];
+    FileInfo records[PARSE_BATCH_LINES];
+} ParseBatch;
+
+// Stages of parse_listing: reader -> parser/hasher workers -> inserter, joined by bounded queues
+typedef struct ParsePipeline {
+    MappedLines mapped;
+    size_t workers;
+    size_t lineCount; // Set by the reader once it reaches the end of the listing
+    BoundedQueue lines; // Batches of line spans for the workers; NULL tells a worker to stop
+    BoundedQueue parsed; // Batches of records for the inserter; NULL tells that a worker stopped
+} ParsePipeline;
+
+// A parser/hasher worker, with its own hashing context and string pool
+typedef struct ParseWorker {
+    ParsePipeline *pipeline;
+    pthread_t thread;
+    StringPool pool; // The worker's string pool, handed over when it stops
+} ParseWorker;
+
+// Reader stage: cut the mapped listing into batches of lines
+static void *read_listing_batches(void *arg) {
+    ParsePipeline *pipeline = arg;
+    const char *at = pipeline->mapped.base;
+    const char *end = pipeline->mapped.base + pipeline->mapped.length;
+    size_t sequence = 0;
+    size_t lineCount = 0;
+    bool more = true;
+    while (more) {
+        ParseBatch *batch = malloc(sizeof(ParseBatch));
+        if (!batch) {
+            perror("Failed to allocate memory for lines");
+            exit(EXIT_FAILURE);
+        }
+        batch->sequence = sequence;
+        batch->lineCount = 0;
+        while (batch->lineCount < PARSE_BATCH_LINES &&
+               (more = next_line_span(&at, end, &batch->lines[batch->lineCount]))) {
+            batch->lineCount++;
+        }
+        if (batch->lineCount == 0) {
+            free(batch);
+            break;
+        }
+        lineCount += batch->lineCount;
+        sequence++;
+        bounded_queue_push(&pipeline->lines, batch);
+    }
+    pipeline->lineCount = lineCount;
+    for (size_t i = 0; i < pipeline->workers; i++) {
+        bounded_queue_push(&pipeline->lines, NULL);
+    }
+    return NULL;
+}
+
+// Worker stage: parse and hash each batch into records whose strings live in the worker's pool
+static void *parse_listing_batches(void *arg) {
+    ParseWorker *worker = arg;
+    ParsePipeline *pipeline = worker->pipeline;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Unable to create hashing context\n");
+        exit(EXIT_FAILURE);
+    }
+    ParseBatch *batch;
+    while ((batch = bounded_queue_pop(&pipeline->lines))) {
+        batch->recordCount = 0;
+        for (size_t i = 0; i < batch->lineCount; i++) {
+            FileInfo *record = &batch->records[batch->recordCount];
+            *record = (FileInfo){0};
+            parse_line_span(batch->lines[i].data, batch->lines[i].length, record, ctx);
+            // Ensure `FileInfo` contains valid data before it goes into the Tree
+            if (record->name && record->path) {
+                batch->recordCount++;
             }
-            *lines = temp;
+        }
+        bounded_queue_push(&pipeline->parsed, batch);
+    }
+    EVP_MD_CTX_free(ctx);
+    worker->pool = *string_pool_current();
+    *string_pool_current() = (StringPool){NULL, 0};
+    bounded_queue_push(&pipeline->parsed, NULL);
+    return NULL;
+}
+
+/**
+ * Parses every line of a listing into records in listing order. A reader thread cuts the mapped listing
+ * into batches of lines, parser/hasher workers (one per remaining core, each with its own EVP context)
+ * turn them into records, and the calling thread inserts finished batches into the record array,
+ * reordering them as they complete. The record strings end up in the calling thread's string pool.
+ */
+static size_t parse_listing(const char *filename, FileInfo **records) {
+    ParsePipeline pipeline = {0};
+    if (map_file_readonly(filename, &pipeline.mapped) != 0) {
+        fprintf(stderr, "Failed to read lines from '%s'.\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    pipeline.workers = cores > 1 ? (size_t) cores - 1 : 1;
+    bounded_queue_init(&pipeline.lines, pipeline.workers * PARSE_QUEUE_DEPTH);
+    bounded_queue_init(&pipeline.parsed, pipeline.workers * PARSE_QUEUE_DEPTH);
+    ParseWorker *workers = calloc(pipeline.workers, sizeof(ParseWorker));
+    if (!workers) {
+        perror("Failed to allocate memory for parser threads");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, read_listing_batches, &pipeline) != 0) {
+        fprintf(stderr, "Failed to create thread: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < pipeline.workers; i++) {
+        workers[i].pipeline = &pipeline;
+        if (pthread_create(&workers[i].thread, NULL, parse_listing_batches, &workers[i]) != 0) {
+            fprintf(stderr, "Failed to create thread: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
 
-            (*lines)[*numLines] = strdup(buffer);
-            if (!(*lines)[*numLines]) {
-                perror("Failed to duplicate buffer");
-                fclose(file);
-                return -1; // Indicate failure
+    // Inserter stage: batches finish out of order, so park them until their turn comes
+    size_t capacity = INITIAL_CAPACITY, count = 0;
+    size_t pendingCapacity = 0, nextSequence = 0;
+    ParseBatch **pending = NULL;
+    *records = malloc(capacity * sizeof(FileInfo));
+    if (!*records) {
+        perror("Failed to allocate memory for records");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t stopped = 0; stopped < pipeline.workers;) {
+        ParseBatch *batch = bounded_queue_pop(&pipeline.parsed);
+        if (!batch) {
+            stopped++;
+            continue;
+        }
+        if (batch->sequence >= pendingCapacity) {
+            const size_t newCapacity = batch->sequence * RESIZE_FACTOR + 1;
+            ParseBatch **temp = realloc(pending, newCapacity * sizeof(ParseBatch *));
+            if (!temp) {
+                perror("Failed to allocate memory for records");
+                exit(EXIT_FAILURE);
+            }
+            memset(temp + pendingCapacity, 0, (newCapacity - pendingCapacity) * sizeof(ParseBatch *));
+            pending = temp;
+            pendingCapacity = newCapacity;
+        }
+        pending[batch->sequence] = batch;
+        while (nextSequence < pendingCapacity && pending[nextSequence]) {
+            ParseBatch *next = pending[nextSequence];
+            if (count + next->recordCount > capacity) {
+                capacity = (count + next->recordCount) * RESIZE_FACTOR;
+                FileInfo *temp = realloc(*records, capacity * sizeof(FileInfo));
+                if (!temp) {
+                    perror("Failed to allocate memory for records");
+                    exit(EXIT_FAILURE);
+                }
+                *records = temp;
             }
-            (*numLines)++;
+            memcpy(*records + count, next->records, next->recordCount * sizeof(FileInfo));
+            count += next->recordCount;
+            free(next);
+            pending[nextSequence++] = NULL;
         }
     }
-    printf("Read %zu lines from file %s \n", *numLines, filename);
+    pthread_join(reader, NULL);
+    printf("Read %zu lines from file %s \n", pipeline.lineCount, filename);
+    // The records keep pointing into the workers' pools, which the calling thread now owns
+    for (size_t i = 0; i < pipeline.workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        string_pool_adopt(string_pool_current(), &workers[i].pool);
+    }
+    free(pending);
+    free(workers);
+    free(pipeline.lines.slots);
+    free(pipeline.parsed.slots);
+    unmap_file_lines(&pipeline.mapped);
+    return count;
+}
+
+// One ordering of the parsed records to build and publish
+typedef struct TreeBuildTask {
+    const FileInfo *records;
+    size_t count;
+    int (*compareFunc)(const FileInfo *, const FileInfo *);
+    const char *prefix;
+    const char *listing; // Listing the records were parsed from, names the published tree
+    const Config *config;
+    bool print;
+    IndexKey key;    // Key the comparator orders by, recorded in the index header
+    bool eytzinger;  // Static Eytzinger layout instead of a red-black tree
+    size_t threads; // Threads the tree may be built on
+} TreeBuildTask;
+
+// Serializes --print output when several trees are built at once
+static pthread_mutex_t printLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Name of the .rbt file a task saves its index to
+static char *saved_index_filename(const TreeBuildTask *task) {
+    size_t bufferSize = strlen(task->prefix) + strlen(task->config->filename) + 1;
+    char tmpFileName[bufferSize];
+    char *listingName = get_filename_from_path(task->config->filename);
+    concatenate_strings(task->prefix, listingName, tmpFileName);
+    free(listingName);
+    return add_rbt_extension(tmpFileName); // Append `.rbt` to the filename
+}
+
+// Sort the nodes by the task's key and publish them in the Eytzinger layout
+static void store_eytzinger_index(const TreeBuildTask *task, Node **nodes) {
+    sort_nodes(nodes, task->count, task->compareFunc);
+    if (task->print) {
+        pthread_mutex_lock(&printLock);
+        printf("\nFiles stored in Eytzinger index in sorted order:\n");
+        char hash[HASH_HEX_LENGTH];
+        for (size_t i = 0; i < task->count; i++) {
+            hash_to_hex(nodes[i]->key.hash, hash);
+            printf("Filename: %s, Size: %zu bytes, Path: %s, Type: %s, Hash: %s\n",
+                   nodes[i]->key.name, nodes[i]->key.size, nodes[i]->key.path,
+                   FILE_TYPES[nodes[i]->key.type], hash);
+        }
+        pthread_mutex_unlock(&printLock);
+    }
+    const EytzingerSource source = {nodes, task->count, task->key};
+    if (task->config->save) {
+        char *storeFilename = saved_index_filename(task);
+        write_eytzinger_to_file(&source, storeFilename);
+        free(storeFilename);
+    } else {
+        write_eytzinger_to_shared_memory(&source, task->listing, task->prefix);
+    }
+}
 
-    fclose(file);
-    return 0; // Indicate success
+// Build one tree over the shared records with nodes from the calling thread's arena, then publish it
+static void *build_and_store_tree(void *arg) {
+    const TreeBuildTask *task = arg;
+    NodeArena *arena = node_arena_current();
+    Node **nodes = malloc((task->count > 0 ? task->count : 1) * sizeof(Node *));
+    if (!nodes) {
+        perror("Failed to allocate memory for nodes");
+        exit(EXIT_FAILURE);
+    }
+    // Nodes copy the record but share its strings, which stay in the parsing thread's pool
+    for (size_t i = 0; i < task->count; i++) {
+        nodes[i] = node_arena_alloc(arena);
+        nodes[i]->key = task->records[i];
+    }
+    if (task->eytzinger) {
+        store_eytzinger_index(task, nodes);
+        free(nodes);
+        node_arena_release(arena);
+        return NULL;
+    }
+    // Red-Black Tree node
+    Node *finalRoot = parallel_bulk_load_tree(nodes, task->count, task->compareFunc, task->threads);
+    free(nodes);
+    // Display the processed files in sorted Red-Black Tree order
+    if (task->print) {
+        pthread_mutex_lock(&printLock);
+        printf("\nFiles stored in Red-Black Tree in sorted order by filename:\n");
+        inorder(finalRoot);
+        pthread_mutex_unlock(&printLock);
+    }
+    // Handle saving to file or shared memory
+    if (task->config->save) {
+        char *storeFilename = saved_index_filename(task);
+        write_tree_to_file(finalRoot, task->key, storeFilename);
+        free(storeFilename);
+    } else {
+        write_tree_to_shared_memory(finalRoot, task->key, task->listing, task->prefix);
+    }
+    // Free the tree; the arena belongs to this thread and holds no other
+    release_thread_trees();
+    return NULL;
 }
 
 /**
@@ -865,11 +2615,12 @@ int read_file_lines(const char *filename, char ***lines, size_t *numLines) {
  *
  * @param argc The count of command-line arguments provided to the program.
  * @param argv An array of command-line argument strings, where the first element is the program name.
- * @param insertFunc A function pointer to be used for inserting nodes into the Red-Black Tree.
- *                   This function should modify the tree structure based on the provided data.
+ * @param compareFunc The key comparator; parsed records are sorted with it and bulk-loaded into a
+ *                    balanced Red-Black Tree.
  * @param prefix A prefix string used for naming or identifying shared memory objects in specific operations.
  */
-void createRbt(const int argc, char *argv[], void (*insertFunc)(Node **, FileInfo), const char *prefix, Config config) {
+void createRbt(const int argc, char *argv[], int (*compareFunc)(const FileInfo *, const FileInfo *), const char *prefix,
+               Config config) {
     if (argc < 2) {
         fprintf(
             stderr,
@@ -877,17 +2628,8 @@ void createRbt(const int argc, char *argv[], void (*insertFunc)(Node **, FileInf
             argv[0]);
         return;
     }
-    bool print = false;
-    for (int i = 1; i < argc; ++i) {
-        // Start at i = 1 to skip program name
-        if (strcmp(argv[i], "--print") == 0) {
-            print = true;
-            break; // Stop checking once found
-        }
-    }
     if (argc == 3 && strcmp(argv[1], "--load") == 0) {
         // Handle the --load command
-        // TODO
         read_tree_from_file_to_shared_memory(argv[2], prefix);
         return;
     }
@@ -901,82 +2643,74 @@ void createRbt(const int argc, char *argv[], void (*insertFunc)(Node **, FileInf
         remove_shared_memory_object_by_name(argv[3]);
         return;
     }
+    createRbts(argc, argv, &compareFunc, &prefix, 1, config);
+}
+
+/**
+ * Parses the listing in argv[2] once and builds one tree per comparator over the same records, each
+ * on its own thread with its own node arena, publishing tree i under prefixes[i].
+ */
+void createRbts(const int argc, char *argv[], int (*compareFuncs[])(const FileInfo *, const FileInfo *),
+                const char *prefixes[], const size_t treeCount, Config config) {
+    bool print = false;
+    for (int i = 1; i < argc; ++i) {
+        // Start at i = 1 to skip program name
+        if (strcmp(argv[i], "--print") == 0) {
+            print = true;
+            break; // Stop checking once found
+        }
+    }
     struct timeval start, end;
     gettimeofday(&start, NULL);
 
-    char **filenames = malloc(2 * sizeof(char *)); // For 2 elements: argv[2] and NULL
-    if (!filenames) {
-        perror("Failed to allocate memory");
-        exit(EXIT_FAILURE);
-    }
-    char *filename = argv[2]; // First element is argv[2]
-    filenames[0] = filename; // First element is argv[2]
-    filenames[1] = NULL; // Second element is NULL
+    set_hash_algorithm(config.hashAlgorithm);
+    FileInfo *records = NULL;
+    const size_t totalProcessedCount = parse_listing(argv[2], &records);
+    printf("Total lines successfully processed: %zu\n", totalProcessedCount);
 
-    char **lines = NULL;
-    size_t numLines = 0;
-    // Call the function to read the file lines
-    if (read_file_lines(filename, &lines, &numLines) != 0) {
-        fprintf(stderr, "Failed to read lines from '%s'.\n", filename);
-        exit(EXIT_FAILURE);
-    }
-    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-    if (ctx == NULL) {
-        fprintf(stderr, "Error: Unable to create hashing context\n");
+    TreeBuildTask *tasks = malloc(treeCount * sizeof(TreeBuildTask));
+    pthread_t *threads = malloc(treeCount * sizeof(pthread_t));
+    if (!tasks || !threads) {
+        perror("Failed to allocate memory for tree builders");
         exit(EXIT_FAILURE);
     }
-
-    Node *finalRoot = NULL; // Red-Black Tree node
-    int totalProcessedCount = 0;
-    // Processing the lines to insert into the Red-Black Tree
-    for (size_t i = 0; i < numLines; i++) {
-        FileInfo key = {0};
-        if (lines != NULL && lines[i] != NULL) {
-            parseFileData(lines[i], &key, ctx);
-        } else {
-            fprintf(stderr, "Error: lines[%ld] is NULL\n", i);
-            continue;
-        }
-        // Ensure `FileInfo` contains valid data and insert into the Tree
-        if (key.name && key.path && key.type) {
-            insertFunc(&finalRoot, key); // Use the provided insertion function
-            totalProcessedCount++;
-        }
-    }
-    // Display the processed files in sorted Red-Black Tree order
-    if (print) {
-        printf("\nFiles stored in Red-Black Tree in sorted order by filename:\n");
-        inorder(finalRoot);
-    }
-    printf("Total lines successfully processed: %d\n", totalProcessedCount);
-
-    // Free the allocated memory for lines
-    for (size_t i = 0; i < numLines; i++) {
-        if (lines != NULL && lines[i] != NULL) {
-            free(lines[i]);
+    // The cores are shared out between the trees built at once
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t buildThreads = cores > (long) treeCount ? (size_t) cores / treeCount : 1;
+    for (size_t i = 0; i < treeCount; i++) {
+        tasks[i] = (TreeBuildTask){records, totalProcessedCount, compareFuncs[i], prefixes[i], argv[2], &config, print,
+                                   index_key_for_prefix(prefixes[i]), false, buildThreads};
+        if (config.eytzinger) {
+            // Only numeric keys have an Eytzinger layout; name and path indexes stay red-black trees
+            if (tasks[i].key == INDEX_KEY_SIZE || tasks[i].key == INDEX_KEY_HASH) {
+                tasks[i].eytzinger = true;
+            } else {
+                printf("The Eytzinger layout covers size and hash indexes, %s stays a red-black tree\n", prefixes[i]);
+            }
         }
     }
-    free(lines);
-
-    // Handle saving to file or shared memory
-    if (config.save) {
-        size_t bufferSize = strlen(prefix) + strlen(config.filename) + 1;
-        char tmpFileName[bufferSize];
-        concatenate_strings(prefix, get_filename_from_path(config.filename), tmpFileName);
-        char *storeFilename = add_rbt_extension(tmpFileName); // Append `.rbt` to the filename
-        write_tree_to_file(finalRoot, storeFilename);
-        free(storeFilename);
+    if (treeCount == 1) {
+        build_and_store_tree(&tasks[0]);
     } else {
-        write_tree_to_shared_memory(finalRoot, argv[2], prefix);
+        for (size_t i = 0; i < treeCount; i++) {
+            if (pthread_create(&threads[i], NULL, build_and_store_tree, &tasks[i]) != 0) {
+                fprintf(stderr, "Failed to create thread: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (size_t i = 0; i < treeCount; i++) {
+            pthread_join(threads[i], NULL);
+        }
     }
     gettimeofday(&end, NULL);
     // Calculate and display elapsed time
     const double elapsed = get_time_difference(start, end);
     print_elapsed_time(NULL, elapsed, stdout, "RBT creation");
-    // Free the tree if it was created or loaded
-    freeTree(finalRoot);
-    free(filenames);
-    EVP_MD_CTX_free(ctx);
+
+    free(threads);
+    free(tasks);
+    free(records);
+    string_pool_release(string_pool_current());
 }
 
 long long getSharedMemorySize(const char *sharedMemoryName) {
@@ -1018,30 +2752,168 @@ EVP_MD_CTX *initialize_evp_context() {
     return mdctx;
 }
 
-void to_lowercase(const wchar_t *input, wchar_t *output) {
-    for (size_t i = 0; input[i] != L'\0'; i++) {
-        switch (input[i]) {
-            case L'Ż': output[i] = L'ż';
-                break;
-            case L'Ź': output[i] = L'ź';
-                break;
-            case L'Ł': output[i] = L'ł';
-                break;
-            case L'Ć': output[i] = L'ć';
-                break;
-            // Add more cases as needed
-            default: output[i] = (wchar_t) towlower(input[i]);
-                break;
+// Lowercase form of a non-ASCII code point, the code point itself when it has none
+static uint32_t lowercase_code_point(const uint32_t codePoint) {
+    size_t lo = 0, hi = LOWERCASE_RANGES_COUNT;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (LOWERCASE_RANGES[mid].last < codePoint) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
-    output[wcslen(input)] = L'\0'; // Null-terminate wide string
+    if (lo < LOWERCASE_RANGES_COUNT && LOWERCASE_RANGES[lo].first <= codePoint &&
+        (codePoint - LOWERCASE_RANGES[lo].first) % LOWERCASE_RANGES[lo].stride == 0) {
+        return codePoint + LOWERCASE_RANGES[lo].delta;
+    }
+    return codePoint;
 }
 
-void concatenate_name_and_size(const FileInfo *result, char *out) {
-    wchar_t lower_name[LINK_LENGTH]; // Buffer for lowercase wide version of result->name
-    wchar_t wide_string[LINK_LENGTH]; // Buffer to hold wide string of result->name
+// Decode the multibyte sequence at s the way mbstowcs does under a UTF-8 locale: up to six bytes, no
+// overlong forms and no surrogates. Returns its length, 0 when it is invalid.
+static size_t utf8_decode(const unsigned char *s, const size_t available, uint32_t *codePoint) {
+    static const uint32_t minimum[] = {0, 0, 0x80, 0x800, 0x10000, 0x200000, 0x4000000};
+    size_t length;
+    uint32_t value;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        length = 2;
+        value = s[0] & 0x1F;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        length = 3;
+        value = s[0] & 0x0F;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        length = 4;
+        value = s[0] & 0x07;
+    } else if ((s[0] & 0xFC) == 0xF8) {
+        length = 5;
+        value = s[0] & 0x03;
+    } else if ((s[0] & 0xFE) == 0xFC) {
+        length = 6;
+        value = s[0] & 0x01;
+    } else {
+        return 0;
+    }
+    if (length > available) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+    if (value < minimum[length] || (value >= 0xD800 && value <= 0xDFFF)) {
+        return 0;
+    }
+    *codePoint = value;
+    return length;
+}
+
+static size_t utf8_encode(const uint32_t codePoint, unsigned char *out) {
+    if (codePoint < 0x80) {
+        out[0] = (unsigned char) codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800) {
+        out[0] = (unsigned char) (0xC0 | codePoint >> 6);
+        out[1] = (unsigned char) (0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if (codePoint < 0x10000) {
+        out[0] = (unsigned char) (0xE0 | codePoint >> 12);
+        out[1] = (unsigned char) (0x80 | (codePoint >> 6 & 0x3F));
+        out[2] = (unsigned char) (0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    out[0] = (unsigned char) (0xF0 | codePoint >> 18); // Lowercase letters all lie below U+110000
+    out[1] = (unsigned char) (0x80 | (codePoint >> 12 & 0x3F));
+    out[2] = (unsigned char) (0x80 | (codePoint >> 6 & 0x3F));
+    out[3] = (unsigned char) (0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+// Lowercase the leading all-ASCII blocks of input into output; returns the number of bytes done
+static size_t ascii_lowercase_blocks(const unsigned char *input, const size_t length, unsigned char *output) {
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i beforeA32 = _mm256_set1_epi8('A' - 1);
+    const __m256i afterZ32 = _mm256_set1_epi8('Z' + 1);
+    const __m256i caseBit32 = _mm256_set1_epi8(0x20);
+    for (; i + 32 <= length; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (input + i));
+        if (_mm256_movemask_epi8(block)) {
+            return i;
+        }
+        const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, beforeA32), _mm256_cmpgt_epi8(afterZ32, block));
+        _mm256_storeu_si256((__m256i *) (output + i), _mm256_or_si256(block, _mm256_and_si256(upper, caseBit32)));
+    }
+#endif
+#ifdef __SSE2__
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= length; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) (input + i));
+        if (_mm_movemask_epi8(block)) {
+            return i; // A byte with the top bit set starts a multibyte sequence
+        }
+        // Bytes are below 0x80 here, so signed comparisons order them correctly
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, beforeA), _mm_cmplt_epi8(block, afterZ));
+        _mm_storeu_si128((__m128i *) (output + i), _mm_or_si128(block, _mm_and_si128(upper, caseBit)));
+    }
+#endif
+    return i;
+}
+
+/**
+ * Lowercases UTF-8 without going through wchar_t or the locale. ASCII is handled a block at a time, other
+ * characters through the table of Unicode lowercase mappings, so the result matches what
+ * mbstowcs/towlower/wcstombs produce under a UTF-8 locale. Characters that do not fit in capacity bytes
+ * are dropped whole, as wcstombs drops them. Returns the bytes written, or (size_t) -1 if input is not
+ * valid UTF-8.
+ */
+size_t utf8_lowercase(const char *input, const size_t length, char *output, const size_t capacity) {
+    const unsigned char *in = (const unsigned char *) input;
+    unsigned char *out = (unsigned char *) output;
+    size_t i = ascii_lowercase_blocks(in, length < capacity ? length : capacity, out);
+    size_t written = i;
+    bool full = false; // Keep validating once output is full, an invalid tail still fails the whole name
+    while (i < length) {
+        if (in[i] < 0x80) {
+            if (written < capacity && !full) {
+                out[written++] = in[i] >= 'A' && in[i] <= 'Z' ? in[i] | 0x20 : in[i];
+            } else {
+                full = true;
+            }
+            i++;
+            continue;
+        }
+        uint32_t codePoint;
+        const size_t sequenceLength = utf8_decode(in + i, length - i, &codePoint);
+        if (sequenceLength == 0) {
+            return (size_t) -1;
+        }
+        const uint32_t lower = lowercase_code_point(codePoint);
+        unsigned char encoded[4];
+        const unsigned char *bytes = in + i;
+        size_t byteCount = sequenceLength;
+        if (lower != codePoint) {
+            byteCount = utf8_encode(lower, encoded);
+            bytes = encoded;
+        }
+        if (!full && written + byteCount <= capacity) {
+            memcpy(out + written, bytes, byteCount);
+            written += byteCount;
+        } else {
+            full = true;
+        }
+        i += sequenceLength;
+    }
+    return written;
+}
 
-    // Convert result->name to a wide string
+void concatenate_name_and_size(const FileInfo *result, char *out) {
     const size_t len = strlen(result->name);
     if (len + 1 > LINK_LENGTH) {
         // Ensure result->name fits in the buffer
@@ -1049,21 +2921,17 @@ void concatenate_name_and_size(const FileInfo *result, char *out) {
         out[0] = '\0'; // Output empty string and return early
         return;
     }
-    convert_char_to_wchar(result->name, wide_string, len + 1);
-
-    // Convert wide string to lowercase and store it in lower_name
-    to_lowercase(wide_string, lower_name);
 
-    // Convert the lowercase wide string back to a narrow string
     char narrow_string_lower_name[LINK_LENGTH];
-    const size_t lower_name_len = wcslen(lower_name);
-    if (lower_name_len + 1 > LINK_LENGTH) {
-        // Ensure it fits in the buffer
-        fprintf(stderr, "Error: lowercased wide string too long");
-        out[0] = '\0'; // Output empty string and return early
-        return;
+    size_t lower_name_len = utf8_lowercase(result->name, len, narrow_string_lower_name, LINK_LENGTH);
+    if (lower_name_len == (size_t) -1) {
+        fprintf(stderr, "Error: Conversion failed.\n");
+        lower_name_len = 0; // Names that are not UTF-8 hash as if they were empty
+    }
+    if (lower_name_len > LINK_LENGTH - 1) {
+        lower_name_len = LINK_LENGTH - 1;
     }
-    convert_wchar_to_char(lower_name, narrow_string_lower_name, LINK_LENGTH);
+    narrow_string_lower_name[lower_name_len] = '\0';
 
     // Safely concatenate and truncate if necessary
     const size_t out_len = snprintf(out, LINK_LENGTH, "%s%zu", narrow_string_lower_name, result->size);
@@ -1075,52 +2943,26 @@ void concatenate_name_and_size(const FileInfo *result, char *out) {
     }
 }
 
-
-void convert_char_to_wchar(const char *input, wchar_t *output, const size_t output_size) {
-    // Set the locale to ensure proper interpretation of input encoding
-    setlocale(LC_ALL, "");
-
-    const size_t result = mbstowcs(output, input, output_size);
-    if (result == (size_t) -1) {
-        wprintf(L"Error: Conversion failed.\n");
-        output[0] = L'\0'; // Null-terminate in case of failure
-    } else {
-        output[output_size - 1] = L'\0';
-    }
-}
-
-void convert_wchar_to_char(const wchar_t *input, char *output, const size_t output_size) {
-    // Set the locale to ensure proper interpretation of wide characters
-    setlocale(LC_ALL, "");
-
-    const size_t result = wcstombs(output, input, output_size);
-    if (result == (size_t) -1) {
-        printf("Error: Conversion failed.\n");
-        output[0] = '\0'; // Null-terminate in case of failure
-    } else {
-        output[output_size - 1] = '\0'; // Ensure the output string is null-terminated
-    }
-}
-
-
-void sha256_first_64bits_to_hex(const char *input, char *output_hex, EVP_MD_CTX *ctx) {
+// First 64 bits of the SHA-256 digest, read big-endian so that they print as the digest's first 16 hex digits
+uint64_t sha256_first_64bits(const char *input, EVP_MD_CTX *ctx) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
     if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
         fprintf(stderr, "Error: Unable to reinitialize context for SHA-256\n");
-        return;
+        return 0;
     }
     if (EVP_DigestUpdate(ctx, input, strlen(input)) != 1) {
         fprintf(stderr, "Error: Unable to update hash with input\n");
-        return;
+        return 0;
     }
     if (EVP_DigestFinal_ex(ctx, hash, NULL) != 1) {
         fprintf(stderr, "Error: Unable to finalize hash\n");
-        return;
+        return 0;
     }
+    uint64_t value = 0;
     for (int i = 0; i < 8; i++) {
-        sprintf(output_hex + (i * 2), "%02x", hash[i]);
+        value = value << 8 | hash[i];
     }
-    output_hex[16] = '\0'; // Null-terminate the string
+    return value;
 }
 
 void concatenate_strings(const char *string1, const char *string2, char *output) {
@@ -1132,3 +2974,152 @@ void concatenate_strings(const char *string1, const char *string2, char *output)
     strcpy(output, string1);
     strcat(output, string2);
 }
+
+// Map a serialized tree from a .rbt file or, for names ending in .mem, from shared memory
+static char *map_serialized_tree(const char *indexName, size_t *length) {
+    const size_t nameLength = strlen(indexName);
+    const size_t memLength = strlen(EXTENSION_MEM);
+    const bool sharedMemory = nameLength >= memLength &&
+                              strcmp(indexName + nameLength - memLength, EXTENSION_MEM) == 0;
+    const int fd = sharedMemory ? shm_open(indexName, O_RDONLY, 0666) : open(indexName, O_RDONLY);
+    if (fd == -1) {
+        perror("Error: Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    struct stat indexStat;
+    if (fstat(fd, &indexStat) == -1 || indexStat.st_size == 0) {
+        fprintf(stderr, "Error: Index %s is empty or unreadable.\n", indexName);
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    char *buffer = mmap(NULL, indexStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED) {
+        perror("Error: Failed to map index");
+        exit(EXIT_FAILURE);
+    }
+    *length = indexStat.st_size;
+    return buffer;
+}
+
+// Key an index (a .rbt file or a shared memory object) is ordered by, read from its header
+IndexKey read_index_key(const char *indexName) {
+    size_t length = 0;
+    char *serialized = map_serialized_tree(indexName, &length);
+    const IndexKey key = (IndexKey) index_header(serialized, length)->key;
+    munmap(serialized, length);
+    return key;
+}
+
+/**
+ * Classifies a line of a listing diff: returns '+' for an added entry, '-' for a removed one and 0 for
+ * anything else. Both unified ("+entry"/"-entry") and normal ("> entry"/"< entry") diff output are
+ * understood; a changed entry shows up as a removal of the old line and an addition of the new one.
+ */
+static char diff_line_kind(const LineSpan *line, LineSpan *entry) {
+    const char *text = line->data;
+    if (line->length >= 3 && (strncmp(text, "+++", 3) == 0 || strncmp(text, "---", 3) == 0)) {
+        return 0; // File headers and the separator of normal diff hunks
+    }
+    if (line->length >= 2 && (text[0] == '>' || text[0] == '<') && text[1] == ' ') {
+        *entry = (LineSpan){text + 2, line->length - 2};
+        return text[0] == '>' ? '+' : '-';
+    }
+    if (line->length >= 2 && (text[0] == '+' || text[0] == '-')) {
+        *entry = (LineSpan){text + 1, line->length - 1};
+        return text[0];
+    }
+    return 0;
+}
+
+/**
+ * Applies a diff between two listings to an existing index (a .rbt file or a shared memory object)
+ * ordered by comparator: removed entries are deleted, added ones inserted, and the index is rewritten.
+ * Only the churned entries are parsed and hashed, but the whole index is deserialized and written out
+ * again, so an update is O(n) for an index of n entries.
+ */
+void applyRbtDiff(const char *diffFilename, const char *indexName,
+                  int (*comparator)(const FileInfo *, const FileInfo *)) {
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    size_t length = 0;
+    char *serialized = map_serialized_tree(indexName, &length);
+    const IndexHeader *header = index_header(serialized, length);
+    if (!index_data_intact(header)) {
+        fprintf(stderr, "Error: Checksum mismatch in %s, the index is corrupt.\n", indexName);
+        exit(EXIT_FAILURE);
+    }
+    // The added and removed entries must hash the way the indexed ones did, and the index keeps its key
+    set_hash_algorithm((HashAlgorithm) header->hashAlgorithm);
+    const IndexKey key = (IndexKey) header->key;
+    Node *root = deserialize_tree(serialized, length);
+    munmap(serialized, length);
+
+    MappedLines mapped;
+    if (map_file_lines(diffFilename, &mapped) != 0) {
+        fprintf(stderr, "Failed to read lines from '%s'.\n", diffFilename);
+        exit(EXIT_FAILURE);
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Unable to create hashing context\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t added = 0, removed = 0, missing = 0;
+    for (size_t i = 0; i < mapped.count; i++) {
+        LineSpan entry;
+        const char kind = diff_line_kind(&mapped.lines[i], &entry);
+        if (kind == 0) {
+            continue;
+        }
+        FileInfo key = {0};
+        parse_line_span(entry.data, entry.length, &key, ctx);
+        if (!key.name || !key.path) {
+            continue;
+        }
+        if (kind == '+') {
+            insert(&root, key, comparator);
+            added++;
+        } else {
+            Node *node = find_node(root, &key, comparator);
+            if (node) {
+                delete_node(&root, node);
+                removed++;
+            } else {
+                fprintf(stderr, "Warning: Removed entry not found in index: %s\n", key.path);
+                missing++;
+            }
+        }
+    }
+    unmap_file_lines(&mapped);
+    EVP_MD_CTX_free(ctx);
+
+    printf("Applied %zu additions and %zu removals to %s (%zu removed entries not found), %zu entries\n",
+           added, removed, indexName, missing, node_count(root));
+    // Either way the new index is written next to the old one and swapped in, so readers never see it half-written
+    if (strlen(indexName) >= strlen(EXTENSION_MEM) &&
+        strcmp(indexName + strlen(indexName) - strlen(EXTENSION_MEM), EXTENSION_MEM) == 0) {
+        write_tree_to_named_shared_memory(root, key, indexName); // Built as <name>.tmp, then renamed
+    } else {
+        const size_t tmpLength = strlen(indexName) + strlen(".tmp") + 1;
+        char *tmpFilename = malloc(tmpLength);
+        if (!tmpFilename) {
+            perror("Failed to allocate memory for filename");
+            exit(EXIT_FAILURE);
+        }
+        snprintf(tmpFilename, tmpLength, "%s.tmp", indexName);
+        write_tree_to_file(root, key, tmpFilename);
+        if (rename(tmpFilename, indexName) == -1) {
+            perror("Error: Failed to replace index");
+            exit(EXIT_FAILURE);
+        }
+        free(tmpFilename);
+    }
+    gettimeofday(&end, NULL);
+    print_elapsed_time(NULL, get_time_difference(start, end), stdout, "RBT update");
+    release_thread_trees();
+    // The deserialized records and the parsed diff lines
+    string_pool_release(string_pool_current());
+}
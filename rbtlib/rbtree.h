@@ -2,6 +2,7 @@
 #define RBTREE_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,39 +22,269 @@
 // Enum to represent node colors
 typedef enum { RED, BLACK } NodeColor;
 
-// File information structure
+// File information structure; the strings live in a StringPool and name points into path
 typedef struct FileInfo {
-    char name[LINK_LENGTH];
+    const char *name;
+    const char *path;
+    const char *linkTarget; // NULL unless the entry is a link with a known target
     size_t size;
-    char path[MAX_LINE_LENGTH];
-    char type[MAX_TYPE_LENGTH];
-    char linkTarget[LINK_LENGTH];
-    char hash[17];
     size_t childrenCount;
+    uint64_t hash; // Name+size hash; rendered as 16 hex digits only for output
+    FileType type; // Index into FILE_TYPES; the name is only looked up for output
     bool isHidden;
     bool isDir;
     int isLink; // 1 is link to file, 2 link to directory
 } FileInfo;
 
+// Bytes per string pool chunk; longer strings get a chunk of their own
+#define STRING_POOL_CHUNK_BYTES (1024 * 1024)
+
+// Block of NUL-terminated strings carved out by a StringPool
+typedef struct StringChunk {
+    struct StringChunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} StringChunk;
+
+// Append-only storage for the strings referenced by FileInfo records, released as a whole
+typedef struct StringPool {
+    StringChunk *chunks;
+    size_t bytes; // Number of string bytes handed out, terminators included
+} StringPool;
+
+// One line of a mapped file, in place: not NUL-terminated and without its newline
+typedef struct LineSpan {
+    const char *data;
+    size_t length;
+} LineSpan;
+
+// A file mapped read-only together with the spans of its non-empty lines
+typedef struct MappedLines {
+    char *base;
+    size_t length;
+    LineSpan *lines;
+    size_t count;
+} MappedLines;
+
 // Node structure for the Red-Black Tree
 typedef struct Node {
     FileInfo key;
     NodeColor color;
+    size_t count; // Number of nodes in the subtree rooted here, the node itself included
+    uint64_t sum; // Sum of key.size over the same subtree
     struct Node *left, *right, *parent;
 } Node;
 
+static inline size_t node_count(const Node *n) {
+    return n ? n->count : 0;
+}
+
+static inline uint64_t node_sum(const Node *n) {
+    return n ? n->sum : 0;
+}
+
+// Bytes per node slab; the number of nodes per slab follows from sizeof(Node)
+#define NODE_SLAB_BYTES (4 * 1024 * 1024)
+
+// Fixed-size block of nodes carved out by a NodeArena
+typedef struct NodeSlab {
+    struct NodeSlab *next;
+    size_t used;
+    size_t capacity;
+    Node nodes[];
+} NodeSlab;
+
+// Chunked node allocator; nodes are never freed one by one, only the whole arena at once
+typedef struct NodeArena {
+    NodeSlab *slabs;
+    size_t count; // Number of nodes handed out
+} NodeArena;
+
+/**
+ * Destination of a streamed serialization. Records are staged in buffer; when it is full the
+ * writer flushes it through `flush`, or grows it (through `grow` if set, realloc otherwise).
+ * The header is written last through `patch` (or straight into the buffer when nothing was flushed).
+ */
+typedef struct TreeWriter {
+    char *buffer;
+    size_t length;    // Bytes staged in the buffer
+    size_t capacity;
+    uint64_t flushed; // Bytes already handed to flush
+    uint64_t released; // File bytes written back and dropped from the page cache
+    uint64_t checksummed; // Bytes already folded into crc
+    uint32_t crc;     // Running CRC32C of the bytes after the header
+    bool (*flush)(struct TreeWriter *writer);
+    bool (*patch)(struct TreeWriter *writer, uint64_t offset, const void *data, size_t length);
+    bool (*grow)(struct TreeWriter *writer, size_t capacity);
+    int fd;           // Output file or shared memory descriptor
+} TreeWriter;
+
+// Algorithms the 64-bit name+size hash of a record can be computed with. An index records the one it
+// was built with, and whoever hashes names to look them up in it must use the same.
+typedef enum { HASH_SHA256, HASH_XXH64 } HashAlgorithm;
+
+#define HASH_ALGORITHM_DEFAULT HASH_XXH64
+
+// Buffer size of a hash rendered by hash_to_hex: 16 hex digits and the terminator
+#define HASH_HEX_LENGTH 17
+
 typedef struct {
     const char *prefix;
     void (*insert_fn)(Node **root, FileInfo key);
+    int (*compare_fn)(const FileInfo *a, const FileInfo *b);
     bool all;
     bool skipCheck;
     bool save;
     const char *filename;
+    const char *index; // Index updated by --apply, a .rbt file or a shared memory object
+    bool eytzinger;    // Publish size and hash indexes in the static Eytzinger layout
+    HashAlgorithm hashAlgorithm; // Hash of the record names and sizes, chosen with --hash-algorithm
 } Config;
 
 #define EXTENSION_RBT ".rbt"
 #define EXTENSION_MEM ".mem"
 
+// Serialized index layout, shared by .rbt files and shared memory segments. Every index starts with an
+// IndexHeader that says what it holds, so a loader can reject a foreign, stale or truncated index and pick
+// its query plan without touching a single record. A tree index is followed by PackedNode records written
+// children-first, so the tree can be walked in place straight from the mapping.
+#define RBT_MAGIC "RBTINDEX"
+#define RBT_MAGIC_LENGTH 8
+// Bumped whenever the header or the record layout changes
+#define RBT_FORMAT_VERSION 7
+
+// Field the records of an index are ordered by
+typedef enum { INDEX_KEY_UNKNOWN, INDEX_KEY_NAME, INDEX_KEY_SIZE, INDEX_KEY_PATH, INDEX_KEY_HASH } IndexKey;
+
+typedef enum { INDEX_LAYOUT_TREE, INDEX_LAYOUT_EYTZINGER } IndexLayout;
+
+typedef struct IndexHeader {
+    char magic[RBT_MAGIC_LENGTH];
+    uint32_t version;       // RBT_FORMAT_VERSION of the writer
+    uint32_t headerSize;    // sizeof(IndexHeader); the records start right after the header
+    uint32_t layout;        // IndexLayout
+    uint32_t key;           // IndexKey the records are ordered by
+    uint32_t hashAlgorithm; // HashAlgorithm of the record hashes
+    uint32_t dataCrc;       // CRC32C of everything after the header, up to used
+    uint64_t count;         // Number of records
+    uint64_t used;          // Serialized bytes, header included
+    uint64_t root;          // Tree: offset of the root record, 0 for an empty tree
+    uint64_t keys;          // Eytzinger: offset of uint64_t[count + 1], record keys in Eytzinger order from slot 1
+    uint64_t ranks;         // Eytzinger: offset of uint64_t[count + 1], position in key order of each slot's record
+    uint64_t records;       // Eytzinger: offset of uint64_t[count], record offsets in key order
+    uint32_t reserved;
+    uint32_t headerCrc;     // CRC32C of the header up to this field
+} IndexHeader;
+
+// Serialized node; left/right hold the distance back to the child record, 0 when there is none.
+// The strings follow the fixed part: path and linkTarget, each NUL-terminated.
+typedef struct PackedNode {
+    uint64_t left;
+    uint64_t right;
+    uint64_t size;
+    uint64_t childrenCount;
+    uint64_t count;      // Number of records in the subtree rooted here, for rank and select queries
+    uint64_t sum;        // Sum of size over the same subtree, for range totals
+    uint64_t hash;
+    uint32_t pathLength;
+    uint32_t nameOffset; // Offset of the file name inside the path
+    uint32_t linkTargetLength;
+    uint8_t color;
+    uint8_t isHidden;
+    uint8_t isDir;
+    uint8_t isLink;
+    uint8_t type;
+    char strings[];
+} PackedNode;
+
+// Static alternative for read-only size and hash indexes (INDEX_LAYOUT_EYTZINGER): the same records, stored
+// in key order, plus a table of their numeric keys in Eytzinger (BFS) order that a branchless lower-bound
+// search walks.
+
+// Nodes already sorted by the comparator matching key, to be written in the Eytzinger layout
+typedef struct EytzingerSource {
+    Node **nodes;
+    size_t count;
+    IndexKey key; // INDEX_KEY_SIZE or INDEX_KEY_HASH
+} EytzingerSource;
+
+// Records are padded so that every PackedNode stays 8-byte aligned
+#define PACKED_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+void index_records_corrupt(void);
+
+/**
+ * Child record `distance` bytes before node, NULL when distance is 0. Children are written before their
+ * parent, at 8-byte aligned offsets, and never before records (the first byte after the header); any
+ * other distance comes from a corrupt index and exits instead of being followed.
+ */
+static inline const PackedNode *packed_child(const PackedNode *node, const uint64_t distance,
+                                             const char *records) {
+    if (distance == 0) {
+        return NULL;
+    }
+    if (distance % 8 != 0 || distance < sizeof(PackedNode) ||
+        distance > (uint64_t) ((const char *) node - records)) {
+        index_records_corrupt();
+    }
+    return (const PackedNode *) ((const char *) node - distance);
+}
+
+static inline const PackedNode *packed_left(const PackedNode *node, const char *records) {
+    return packed_child(node, node->left, records);
+}
+
+static inline const PackedNode *packed_right(const PackedNode *node, const char *records) {
+    return packed_child(node, node->right, records);
+}
+
+static inline uint64_t packed_count(const PackedNode *node) {
+    return node ? node->count : 0;
+}
+
+static inline uint64_t packed_sum(const PackedNode *node) {
+    return node ? node->sum : 0;
+}
+
+// Fill a FileInfo whose strings point straight into the record, without copying them
+static inline void packed_file_info(const PackedNode *node, FileInfo *info) {
+    info->path = node->strings;
+    info->name = node->strings + node->nameOffset;
+    info->linkTarget = node->linkTargetLength ? node->strings + node->pathLength + 1 : NULL;
+    info->size = node->size;
+    info->childrenCount = node->childrenCount;
+    info->hash = node->hash;
+    info->type = node->type;
+    info->isHidden = node->isHidden;
+    info->isDir = node->isDir;
+    info->isLink = node->isLink;
+}
+
+// Numeric key of a record in an Eytzinger index
+static inline uint64_t eytzinger_key(const FileInfo *info, const IndexKey key) {
+    return key == INDEX_KEY_SIZE ? (uint64_t) info->size : info->hash;
+}
+
+// Root record of a tree index, NULL for an empty tree
+static inline const PackedNode *index_tree_root(const IndexHeader *header) {
+    return header->root ? (const PackedNode *) ((const char *) header + header->root) : NULL;
+}
+
+// First byte after the header, where the records of a validated index start
+static inline const char *index_records(const IndexHeader *header) {
+    return (const char *) header + header->headerSize;
+}
+
+static inline const PackedNode *eytzinger_record(const char *base, const IndexHeader *header, const uint64_t i) {
+    const uint64_t offset = ((const uint64_t *) (base + header->records))[i];
+    if (offset % 8 != 0 || offset < header->headerSize || offset > header->used ||
+        header->used - offset < sizeof(PackedNode)) {
+        index_records_corrupt();
+    }
+    return (const PackedNode *) (base + offset);
+}
+
 #define ROTATE_LEFT(root, n)              \
     do {                                  \
         Node *r = (n)->right;             \
@@ -69,6 +300,10 @@ typedef struct {
             (n)->parent->right = r;       \
         r->left = (n);                    \
         (n)->parent = r;                  \
+        r->count = (n)->count;            \
+        r->sum = (n)->sum;                \
+        (n)->count = node_count((n)->left) + node_count((n)->right) + 1; \
+        (n)->sum = node_sum((n)->left) + node_sum((n)->right) + (n)->key.size; \
     } while (0)
 
 #define ROTATE_RIGHT(root, n)             \
@@ -86,6 +321,10 @@ typedef struct {
             (n)->parent->right = l;       \
         l->right = (n);                   \
         (n)->parent = l;                  \
+        l->count = (n)->count;            \
+        l->sum = (n)->sum;                \
+        (n)->count = node_count((n)->left) + node_count((n)->right) + 1; \
+        (n)->sum = node_sum((n)->left) + node_sum((n)->right) + (n)->key.size; \
     } while (0)
 
 #define DEFINE_COMPARATOR_BY_FIELD(FIELD, CMP_FUNC)                       \
@@ -106,17 +345,49 @@ insert(root, key, compareBy##FIELD);                                \
 // Function declarations
 
 // Memory and Tree Management
+Node *node_arena_alloc(NodeArena *arena);
+
+void node_arena_release(NodeArena *arena);
+
+NodeArena *node_arena_current(void);
+
+const char *string_pool_store(StringPool *pool, const char *str, size_t length);
+
+void string_pool_release(StringPool *pool);
+
+void string_pool_adopt(StringPool *pool, StringPool *from);
+
+StringPool *string_pool_current(void);
+
 Node *createNode(FileInfo key, NodeColor color, Node *parent);
 
-void freeTree(Node *node);
+void release_thread_trees(void);
+
+Node *deserialize_node(const PackedNode *packed, Node *parent, const char *records);
+
+Node *deserialize_tree(const char *buffer, size_t length);
+
+const PackedNode *packed_tree_root(const char *buffer, size_t length);
 
-void freeFileInfo(FileInfo *fileInfo);
+const IndexHeader *index_header(const char *buffer, size_t length);
 
-Node *deserialize_node(char *buffer, size_t *currentOffset);
+bool index_data_intact(const IndexHeader *header);
 
-void freeNode(Node *node);
+const char *index_key_name(IndexKey key);
 
-void search_tree_for_size_and_type(Node *root, size_t targetSize, const char *targetType);
+IndexKey index_key_for_prefix(const char *prefix);
+
+IndexKey read_index_key(const char *indexName);
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+// Order statistics over a serialized tree, O(log n) through the per-record subtree counts and sums
+uint64_t packed_tree_rank(const PackedNode *root, const char *records, const FileInfo *key,
+                          int (*comparator)(const FileInfo *, const FileInfo *), bool inclusive, uint64_t *sum);
+
+const PackedNode *packed_tree_select(const PackedNode *root, const char *records, uint64_t index);
+
+void search_tree_for_size_and_type(Node *root, size_t targetSize, FileType targetType);
 
 static inline Node *grandparent(Node *n) {
     return (n && n->parent) ? n->parent->parent : NULL;
@@ -135,13 +406,39 @@ void insert(Node **root, const FileInfo key, int (*comparator)(const FileInfo *,
 
 void inorder(const Node *node);
 
+// Iterative traversal engine; the walks follow parent links, so they need neither recursion nor a stack
+const Node *tree_inorder_first(const Node *root);
+
+const Node *tree_inorder_next(const Node *root, const Node *node);
+
+const Node *tree_postorder_first(const Node *root);
+
+const Node *tree_postorder_next(const Node *root, const Node *node);
+
 void insert_rebalance(Node **root, Node *n);
 
+void delete_node(Node **root, Node *z);
+
+void delete_rebalance(Node **root, Node *x, Node *parent);
+
+Node *find_node(Node *root, const FileInfo *key, int (*comparator)(const FileInfo *, const FileInfo *));
+
+void sort_nodes(Node **nodes, size_t count, int (*comparator)(const FileInfo *, const FileInfo *));
+
+Node *build_balanced_tree(Node **nodes, size_t count);
+
+Node *bulk_load_tree(Node **nodes, size_t count, int (*comparator)(const FileInfo *, const FileInfo *));
+
+Node *join_trees(Node *left, Node *separator, Node *right);
+
+Node *parallel_bulk_load_tree(Node **nodes, size_t count, int (*comparator)(const FileInfo *, const FileInfo *),
+                              size_t threads);
+
 int compareByFilename(const FileInfo *a, const FileInfo *b);
 
 int compareByFilesize(const FileInfo *a, const FileInfo *b);
 
-void search_tree_for_name_and_type(Node *root, const char *namePattern, const char *targetType);
+void search_tree_for_name_and_type(Node *root, const char *namePattern, FileType targetType);
 
 // Rotation Operations
 void rotate_left(Node **root, Node *n);
@@ -151,29 +448,53 @@ void rotate_right(Node **root, Node *n);
 // Serialization and Deserialization
 size_t serialize_file_info(const FileInfo *fileInfo, char *buffer);
 
-size_t deserialize_file_info(FileInfo *fileInfo, const char *buffer);
+void deserialize_file_info(FileInfo *fileInfo, const PackedNode *packed);
 
-long long serialize_node(Node *node, char *buffer);
+void tree_writer_init_memory(TreeWriter *writer, size_t capacity);
 
-size_t calc_file_info_size(const FileInfo *fileInfo);
+void tree_writer_init_file(TreeWriter *writer, int fd, size_t capacity);
 
-long long calc_tree_size(const Node *node);
+void tree_writer_init_shared_memory(TreeWriter *writer, int fd, size_t capacity);
 
-size_t serialize_file_info(const FileInfo *fileInfo, char *buffer);
+void tree_writer_free(TreeWriter *writer);
+
+uint64_t serialize_node(const Node *node, TreeWriter *writer, uint64_t leftOffset, uint64_t rightOffset);
+
+uint64_t serialize_tree(const Node *root, IndexKey key, TreeWriter *writer);
+
+uint64_t serialize_eytzinger(const EytzingerSource *source, TreeWriter *writer);
+
+size_t calc_file_info_size(const FileInfo *fileInfo);
 
 void compute_and_store_hash(FileInfo *result, EVP_MD_CTX *ctx);
 
+void set_hash_algorithm(HashAlgorithm algorithm);
+
+HashAlgorithm current_hash_algorithm(void);
+
+const char *hash_algorithm_name(HashAlgorithm algorithm);
+
+bool parse_hash_algorithm(const char *name, HashAlgorithm *algorithm);
+
+uint64_t xxh64(const void *input, size_t length, uint64_t seed);
+
 // File Operations
 void store_rbt_to_file(Node *root, const char *filename);
 
-void write_tree_to_file(Node *finalRoot, const char *filename);
+void write_tree_to_file(Node *finalRoot, IndexKey key, const char *filename);
 
 Node *load_rbt_from_file(const char *filename);
 
 void read_tree_from_file_to_shared_memory(char *filename, const char *prefix);
 
 // Shared Memory Operations
-void write_tree_to_shared_memory(Node *finalRoot, const char *filePath, const char *prefix);
+void write_tree_to_shared_memory(Node *finalRoot, IndexKey key, const char *filePath, const char *prefix);
+
+void write_tree_to_named_shared_memory(Node *finalRoot, IndexKey key, const char *sharedMemoryName);
+
+void write_eytzinger_to_shared_memory(const EytzingerSource *source, const char *filePath, const char *prefix);
+
+void write_eytzinger_to_file(const EytzingerSource *source, const char *filename);
 
 int remove_shared_memory_object(char **argv, const char *prefix);
 
@@ -185,30 +506,41 @@ void remove_trailing_newline(char *str);
 
 void parseFileData(const char *inputLine, FileInfo *result, EVP_MD_CTX *ctx);
 
+void parse_line_span(const char *line, size_t length, FileInfo *result, EVP_MD_CTX *ctx);
+
 char *add_rbt_extension(const char *filename);
 
 char *get_filename_from_path(const char *path);
 
 void listSharedMemoryEntities(const char *prefix);
 
-void createRbt(const int argc, char *argv[], void (*insertFunc)(Node **, FileInfo), const char *prefix, Config config);
+void createRbt(const int argc, char *argv[], int (*compareFunc)(const FileInfo *, const FileInfo *), const char *prefix,
+               Config config);
+
+void createRbts(int argc, char *argv[], int (*compareFuncs[])(const FileInfo *, const FileInfo *),
+                const char *prefixes[], size_t treeCount, Config config);
+
+void applyRbtDiff(const char *diffFilename, const char *indexName,
+                  int (*comparator)(const FileInfo *, const FileInfo *));
 
 long long getSharedMemorySize(const char *sharedMemoryName);
 
 void compute_md5(const char *input, char *output);
 
-void to_lowercase(const wchar_t *input, wchar_t *output);
+size_t utf8_lowercase(const char *input, size_t length, char *output, size_t capacity);
 
 void concatenate_name_and_size(const FileInfo *result, char *out);
 
-void convert_char_to_wchar(const char *input, wchar_t *output, size_t output_size);
+uint64_t sha256_first_64bits(const char *input, EVP_MD_CTX *ctx);
 
-void convert_wchar_to_char(const wchar_t *input, char *output, size_t output_size);
+void hash_to_hex(uint64_t hash, char *hex);
 
-void sha256_first_64bits_to_hex(const char *input, char *output_hex, EVP_MD_CTX *ctx);
+bool hex_to_hash(const char *hex, uint64_t *hash);
 
 void concatenate_strings(const char *string1, const char *string2, char *output);
 
-int read_file_lines(const char *filename, char ***lines, size_t *numLines);
+int map_file_lines(const char *filename, MappedLines *mapped);
+
+void unmap_file_lines(MappedLines *mapped);
 
 #endif // RBTREE_H
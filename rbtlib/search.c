@@ -5,7 +5,6 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
-#include <regex.h>
 #include <unistd.h>
 #include "rbtree.h"
 #include "search.h"
@@ -16,6 +15,10 @@
 
 #include "../shared/shared.h"
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
 int MAX_THREADS = 1;
 
 // Global thread counter
@@ -23,8 +26,11 @@ int active_threads = 0;
 pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t thread_counter_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t thread_cond = PTHREAD_COND_INITIALIZER;
+// Guards the result map and the match counter shared by the search threads
+pthread_mutex_t results_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-void map_results_add_node(MapResults *mapResults, Node *node, const char *key) {
+// The entry for key, created empty on first use
+static NodeHashmapEntry *map_results_entry(MapResults *mapResults, const char *key) {
     NodeHashmapEntry *entry;
     // Check if the key exists in the hashmap
     HASH_FIND_STR(mapResults->entry, key, entry);
@@ -37,7 +43,7 @@ void map_results_add_node(MapResults *mapResults, Node *node, const char *key) {
         }
         // Initialize the new NodeHashmapEntry
         entry->key = strdup(key); // Use strdup to copy the key
-        entry->data = malloc(10 * sizeof(Node *)); // Start with an initial capacity of 10
+        entry->data = malloc(10 * sizeof(const PackedNode *)); // Start with an initial capacity of 10
         if (!entry->data) {
             perror("Failed to allocate initial memory for Node array in NodeHashmapEntry");
             exit(EXIT_FAILURE);
@@ -47,11 +53,14 @@ void map_results_add_node(MapResults *mapResults, Node *node, const char *key) {
         HASH_ADD_STR(mapResults->entry, key, entry); // Add the entry to the hashmap
         mapResults->size++; // Increment the total number of keys in the hashmap
     }
-    // If the entry exists or is newly created, add the Node to its data array
+    return entry;
+}
+
+static void node_hashmap_entry_append(NodeHashmapEntry *entry, const PackedNode *node) {
     if (entry->data_count == entry->capacity) {
         // Resize the data array if full
         entry->capacity *= 2;
-        entry->data = realloc(entry->data, entry->capacity * sizeof(Node *));
+        entry->data = realloc(entry->data, entry->capacity * sizeof(const PackedNode *));
         if (!entry->data) {
             perror("Failed to resize Node array in NodeHashmapEntry");
             exit(EXIT_FAILURE);
@@ -61,6 +70,33 @@ void map_results_add_node(MapResults *mapResults, Node *node, const char *key) {
     entry->data[entry->data_count++] = node;
 }
 
+void map_results_add_node(MapResults *mapResults, const PackedNode *node, const char *key) {
+    // The search threads share one result map
+    pthread_mutex_lock(&results_mutex);
+    node_hashmap_entry_append(map_results_entry(mapResults, key), node);
+    pthread_mutex_unlock(&results_mutex);
+}
+
+void map_results_reserve_buckets(MapResults *mapResults, const size_t count) {
+    mapResults->buckets = calloc(count, sizeof(NodeHashmapEntry *));
+    if (!mapResults->buckets) {
+        perror("Failed to allocate memory for result buckets");
+        exit(EXIT_FAILURE);
+    }
+    mapResults->buckets_count = count;
+}
+
+void map_results_add_to_bucket(MapResults *mapResults, const size_t bucket, const PackedNode *node,
+                               const char *key) {
+    pthread_mutex_lock(&results_mutex);
+    // The key is looked up once, on the bucket's first node
+    if (mapResults->buckets[bucket] == NULL) {
+        mapResults->buckets[bucket] = map_results_entry(mapResults, key);
+    }
+    node_hashmap_entry_append(mapResults->buckets[bucket], node);
+    pthread_mutex_unlock(&results_mutex);
+}
+
 void cleanup_map_results(MapResults *mapResults) {
     NodeHashmapEntry *entry, *tmp;
     // Free all hashmap entries
@@ -71,6 +107,9 @@ void cleanup_map_results(MapResults *mapResults) {
         free(entry); // Free hashmap entry
     }
     mapResults->size = 0;
+    free(mapResults->buckets);
+    mapResults->buckets = NULL;
+    mapResults->buckets_count = 0;
 }
 
 // Free the memory used by the dynamic array
@@ -81,7 +120,12 @@ void node_array_free(NodeArray *array) {
     array->capacity = 0;
 }
 
-Node *load_tree_from_shared_memory(const char *name) {
+/**
+ * Maps a serialized index read-only. The records are walked in place, so start-up does not depend on
+ * the index size and concurrent searches share the same physical pages. The mapping stays in place
+ * for the lifetime of the process.
+ */
+const char *map_shared_memory_index(const char *name, size_t *length) {
     // Open the shared memory object
     const int shm_fd = shm_open(name, O_RDONLY, 0666);
     if (shm_fd == -1) {
@@ -102,267 +146,559 @@ Node *load_tree_from_shared_memory(const char *name) {
         close(shm_fd);
         return NULL;
     }
-    // Deserialize the tree from the shared memory
-    size_t offset = 0; // Tracks the current position in the byte stream
-    Node *root = deserialize_node(ptr, &offset);
-    // Cleanup: Unmap the shared memory and close the file descriptor
-    munmap(ptr, shm_stat.st_size);
+    // The mapping remains valid after the descriptor is closed
     close(shm_fd);
 
-    return root; // Return the deserialized root node
+    *length = shm_stat.st_size;
+    return ptr;
 }
 
-// Helper function to generate the regex string from a glob-style pattern
-char *convert_glob_to_regex(const char *namePattern) {
-    // Allocate a string for the regex (starting with double the size for safety)
-    const int len = (int) strlen(namePattern);
-    int allocated_size = len * 2 + 3; // Extra space for potential escapes, anchors
-    char *regexPattern = malloc(allocated_size);
-    if (!regexPattern) {
-        perror("Failed to allocate memory for regex pattern");
-        exit(EXIT_FAILURE);
+// Maps a serialized tree read-only and returns its root record
+const PackedNode *load_tree_from_shared_memory(const char *name) {
+    size_t length = 0;
+    const char *buffer = map_shared_memory_index(name, &length);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    return packed_tree_root(buffer, length);
+}
+
+void print_node_info(const FileInfo *info) {
+    if (!info) {
+        printf("Invalid node!\n");
+        return;
     }
+    // Print details about the node
+    printf("%s: %s | %s (%zu) | %s | %s\n",
+                   info->type == T_DIR
+                       ? "Dir"
+                       : info->type == T_LINK_DIR || info->type == T_LINK_FILE
+                             ? "Link"
+                             : "File",
+                   FILE_TYPES[info->type], getFileSizeAsString((long long) info->size), info->size, info->name,
+                   info->path);
+}
 
-    // Build the regex pattern
-    char *p = regexPattern;
-    *p++ = '^'; // Add start anchor
+// True when the segment matches the bytes at str, which has at least segment->length of them
+static bool glob_segment_equals(const GlobSegment *segment, const char *str) {
+    if (!segment->anyChar) {
+        return memcmp(segment->text, str, segment->length) == 0;
+    }
+    for (size_t i = 0; i < segment->length; i++) {
+        if (segment->text[i] != '?' && segment->text[i] != str[i]) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    for (int i = 0; i < len; i++) {
-        // Expand memory dynamically if needed (e.g., large input strings)
-        if ((p - regexPattern) + 2 >= allocated_size) {
-            // Ensure space for 2 extra characters
-            allocated_size *= 2;
-            regexPattern = realloc(regexPattern, allocated_size);
-            if (!regexPattern) {
-                perror("Failed to reallocate memory for regex pattern");
-                exit(EXIT_FAILURE);
+// Leftmost place in str[0, length) where the segment matches, or NULL. Only the offsets whose first and
+// last literal bytes line up with the segment's are compared in full.
+static const char *glob_segment_find(const GlobSegment *segment, const char *str, const size_t length) {
+    if (segment->length > length) {
+        return NULL;
+    }
+    if (segment->firstLiteral < 0) {
+        return str; // Only '?', any place with enough bytes matches
+    }
+    const size_t lastStart = length - segment->length;
+    const size_t first = segment->firstLiteral;
+    const size_t last = segment->lastLiteral;
+    const char firstByte = segment->text[first];
+    const char lastByte = segment->text[last];
+    size_t i = 0;
+#ifdef __SSE2__
+    // Sixteen candidate offsets per step; the loads never read past str[length - 1]
+    const __m128i firstBytes = _mm_set1_epi8(firstByte);
+    const __m128i lastBytes = _mm_set1_epi8(lastByte);
+    for (; i + 15 <= lastStart; i += 16) {
+        const __m128i heads = _mm_loadu_si128((const __m128i *) (str + i + first));
+        const __m128i tails = _mm_loadu_si128((const __m128i *) (str + i + last));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(heads, firstBytes),
+                                                            _mm_cmpeq_epi8(tails, lastBytes)));
+        while (mask != 0) {
+            const size_t at = i + __builtin_ctz(mask);
+            if (glob_segment_equals(segment, str + at)) {
+                return str + at;
             }
-            p = regexPattern + strlen(regexPattern); // Reset `p` after realloc
+            mask &= mask - 1;
         }
-        switch (namePattern[i]) {
-            case '*': // Convert glob `*` to regex `.*`
-                *p++ = '.';
-                *p++ = '*';
-                break;
-
-            case '?': // Convert glob `?` to regex `.`
-                *p++ = '.';
-                break;
+    }
+#endif
+    while (i <= lastStart) {
+        const char *hit = memchr(str + i + first, firstByte, lastStart - i + 1);
+        if (hit == NULL) {
+            return NULL;
+        }
+        i = hit - str - first;
+        if (str[i + last] == lastByte && glob_segment_equals(segment, str + i)) {
+            return str + i;
+        }
+        i++;
+    }
+    return NULL;
+}
 
-            case ' ': // Handle space explicitly (literal match)
-                *p++ = '\\';
-                *p++ = ' ';
-                break;
+bool query_matcher_matches(const QueryMatcher *matcher, const char *str, const size_t length) {
+    if (length < matcher->minLength) {
+        return false;
+    }
+    const GlobSegment *head = &matcher->segments[0];
+    if (matcher->segments_count == 1) {
+        return length == head->length && glob_segment_equals(head, str);
+    }
+    // Anchored ends first: a plain suffix compare settles the common '*.ext'
+    const GlobSegment *tail = &matcher->segments[matcher->segments_count - 1];
+    if (!glob_segment_equals(tail, str + length - tail->length) || !glob_segment_equals(head, str)) {
+        return false;
+    }
+    // The segments between stars are found leftmost-first; taking the earliest match never rules out a
+    // later segment, so no backtracking is needed
+    const char *cursor = str + head->length;
+    const char *end = str + length - tail->length;
+    for (int i = 1; i < matcher->segments_count - 1; i++) {
+        const GlobSegment *segment = &matcher->segments[i];
+        if (segment->length == 0) {
+            continue;
+        }
+        const char *found = glob_segment_find(segment, cursor, end - cursor);
+        if (found == NULL) {
+            return false;
+        }
+        cursor = found + segment->length;
+    }
+    return true;
+}
 
-            // Escape regex special characters
-            case '.':
-            case '^':
-            case '$':
-            case '+':
-            case '(':
-            case ')':
-            case '[':
-            case ']':
-            case '{':
-            case '}':
-            case '|':
-            case '\\':
-            case '!':
-                *p++ = '\\';
-                *p++ = namePattern[i];
-                break;
+// The longest run of literal bytes in the pattern, the part every match has to contain
+static void query_matcher_anchor(const QueryMatcher *matcher, const char **anchor, size_t *anchorLength) {
+    *anchor = NULL;
+    *anchorLength = 0;
+    for (int i = 0; i < matcher->segments_count; i++) {
+        const GlobSegment *segment = &matcher->segments[i];
+        size_t run = 0;
+        for (size_t k = 0; k <= segment->length; k++) {
+            if (k < segment->length && segment->text[k] != '?') {
+                run++;
+                continue;
+            }
+            if (run > *anchorLength) {
+                *anchor = segment->text + k - run;
+                *anchorLength = run;
+            }
+            run = 0;
+        }
+    }
+}
 
-            default: // Default case: Add the character directly
-                *p++ = namePattern[i];
-                break;
+static PatternAutomaton *build_pattern_automaton(const QueryMatcher *matchers, const int count) {
+    PatternAutomaton *automaton = calloc(1, sizeof(PatternAutomaton));
+    const char **anchors = malloc(count * sizeof(char *));
+    size_t *anchorLengths = malloc(count * sizeof(size_t));
+    automaton->next_pattern = malloc(count * sizeof(int));
+    automaton->unanchored = malloc(count * sizeof(int));
+    if (!automaton || !anchors || !anchorLengths || !automaton->next_pattern || !automaton->unanchored) {
+        perror("Failed to allocate memory for the pattern automaton");
+        exit(EXIT_FAILURE);
+    }
+    // Only bytes that occur in an anchor get a class of their own; every other byte leads back to the root
+    size_t maxStates = 1;
+    for (int i = 0; i < count; i++) {
+        query_matcher_anchor(&matchers[i], &anchors[i], &anchorLengths[i]);
+        maxStates += anchorLengths[i];
+        for (size_t k = 0; k < anchorLengths[i]; k++) {
+            automaton->classes[(unsigned char) anchors[i][k]] = 1;
+        }
+    }
+    int classes = 1;
+    for (int c = 0; c < 256; c++) {
+        automaton->classes[c] = automaton->classes[c] ? classes++ : 0;
+    }
+    automaton->classes_count = classes;
+    automaton->transitions = malloc(maxStates * classes * sizeof(int));
+    automaton->outputs = malloc(maxStates * sizeof(int));
+    automaton->dictionary = malloc(maxStates * sizeof(int));
+    int *failure = malloc(maxStates * sizeof(int));
+    if (!automaton->transitions || !automaton->outputs || !automaton->dictionary || !failure) {
+        perror("Failed to allocate memory for the pattern automaton");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < maxStates * classes; i++) {
+        automaton->transitions[i] = -1;
+    }
+    // The trie of anchors. Patterns are added last to first so that every output list is in pattern order.
+    automaton->states_count = 1;
+    automaton->outputs[0] = -1;
+    for (int i = count - 1; i >= 0; i--) {
+        if (anchorLengths[i] == 0) {
+            continue;
+        }
+        int state = 0;
+        for (size_t k = 0; k < anchorLengths[i]; k++) {
+            int *next = &automaton->transitions[state * classes + automaton->classes[(unsigned char) anchors[i][k]]];
+            if (*next < 0) {
+                *next = automaton->states_count++;
+                automaton->outputs[*next] = -1;
+            }
+            state = *next;
         }
+        automaton->next_pattern[i] = automaton->outputs[state];
+        automaton->outputs[state] = i;
     }
-    *p++ = '$'; // Add end anchor
-    *p = '\0'; // Null-terminate the string
+    for (int i = 0; i < count; i++) {
+        if (anchorLengths[i] == 0) {
+            automaton->unanchored[automaton->unanchored_count++] = i;
+        }
+    }
+    // Breadth-first over the trie: failure links, dictionary links and the missing transitions, which
+    // turn the trie into a DFA that never backs up
+    int *queue = malloc(automaton->states_count * sizeof(int));
+    if (!queue) {
+        perror("Failed to allocate memory for the pattern automaton");
+        exit(EXIT_FAILURE);
+    }
+    size_t head = 0, tail = 0;
+    queue[tail++] = 0;
+    failure[0] = 0;
+    automaton->dictionary[0] = -1;
+    while (head < tail) {
+        const int state = queue[head++];
+        for (int c = 0; c < classes; c++) {
+            int *next = &automaton->transitions[state * classes + c];
+            if (*next < 0) {
+                *next = state == 0 ? 0 : automaton->transitions[failure[state] * classes + c];
+                continue;
+            }
+            const int child = *next;
+            const int fallback = state == 0 ? 0 : automaton->transitions[failure[state] * classes + c];
+            failure[child] = fallback;
+            automaton->dictionary[child] = automaton->outputs[fallback] >= 0
+                                               ? fallback
+                                               : automaton->dictionary[fallback];
+            queue[tail++] = child;
+        }
+    }
+    free(queue);
+    free(failure);
+    free(anchors);
+    free(anchorLengths);
+    return automaton;
+}
 
-    return regexPattern; // Return the final regex
+static void free_pattern_automaton(PatternAutomaton *automaton) {
+    if (automaton == NULL) {
+        return;
+    }
+    free(automaton->transitions);
+    free(automaton->outputs);
+    free(automaton->dictionary);
+    free(automaton->next_pattern);
+    free(automaton->unanchored);
+    free(automaton);
 }
 
-void print_node_info(const Node *node) {
-    if (!node) {
-        printf("Invalid node!\n");
+int query_first_match(const Arguments *arguments, const char *str, const size_t length) {
+    const PatternAutomaton *automaton = arguments->automaton;
+    if (automaton == NULL) {
+        for (int i = 0; i < arguments->matchers_count; i++) {
+            if (query_matcher_matches(&arguments->matchers[i], str, length)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    // Patterns are tried in order and the first match wins, so only patterns before the best so far count
+    int best = arguments->matchers_count;
+    for (int i = 0; i < automaton->unanchored_count && automaton->unanchored[i] < best; i++) {
+        if (query_matcher_matches(&arguments->matchers[automaton->unanchored[i]], str, length)) {
+            best = automaton->unanchored[i];
+        }
+    }
+    // One pass over the subject finds every anchor; the glob is checked only for patterns whose anchor occurs
+    int state = 0;
+    for (size_t i = 0; i < length && best > 0; i++) {
+        state = automaton->transitions[state * automaton->classes_count + automaton->classes[(unsigned char) str[i]]];
+        for (int hit = automaton->outputs[state] >= 0 ? state : automaton->dictionary[state]; hit >= 0;
+             hit = automaton->dictionary[hit]) {
+            for (int pattern = automaton->outputs[hit]; pattern >= 0 && pattern < best;
+                 pattern = automaton->next_pattern[pattern]) {
+                if (query_matcher_matches(&arguments->matchers[pattern], str, length)) {
+                    best = pattern;
+                    break;
+                }
+            }
+        }
+    }
+    return best < arguments->matchers_count ? best : -1;
+}
+
+void compile_query_matchers(Arguments *arguments) {
+    // -n wins over -p, the same way search_tree picks what to compare
+    char **patterns = arguments->names != NULL ? arguments->names : arguments->paths;
+    const int count = arguments->names != NULL ? arguments->names_count : arguments->paths_count;
+    if (patterns == NULL || count <= 0) {
         return;
     }
-    // Print details about the node
-    printf("%s: %s | %s (%zu) | %s | %s\n",
-                   (strcmp(node->key.type, "T_DIR") == 0)
-                       ? "Dir"
-                       : (strcmp(node->key.type, "T_LINK_DIR") == 0 || strcmp(node->key.type, "T_LINK_FILE") == 0)
-                             ? "Link"
-                             : "File",
-                   node->key.type, getFileSizeAsString((long long) node->key.size), node->key.size, node->key.name,
-                   node->key.path);
-}
-
-int matches_pattern(const char *str, char **names, const int names_count) {
-    // Create a buffer to hold the full regex pattern for all names
-    size_t total_length = 0;
-    for (int i = 0; i < names_count; i++) {
-        char *glob = convert_glob_to_regex(names[i]);
-        total_length += strlen(glob) + 3; // Include space for '|', parentheses, or '\0'.
-        free(glob); // Free the temporary converted regex string
-    }
-    // Allocate memory for the combined regex pattern
-    char *regexPattern = malloc(total_length + 3); // Additional space for start/end parenthesis
-    if (!regexPattern) {
-        fprintf(stderr, "Memory allocation failed.\n");
+    QueryMatcher *matchers = calloc(count, sizeof(QueryMatcher));
+    if (matchers == NULL) {
+        perror("Failed to allocate memory for query matchers");
         exit(EXIT_FAILURE);
     }
-    // Construct the full regex: Combine all names into a single OR regex, e.g., "(name1|name2|name3)"
-    strcpy(regexPattern, "(");
-    for (int i = 0; i < names_count; i++) {
-        char *glob = convert_glob_to_regex(names[i]);
-        strcat(regexPattern, glob); // Append each regex converted glob
-        free(glob); // Free memory from each converted glob
-        if (i < names_count - 1) {
-            strcat(regexPattern, "|"); // Add OR operator between patterns
+    for (int i = 0; i < count; i++) {
+        QueryMatcher *matcher = &matchers[i];
+        const char *pattern = patterns[i];
+        // A glob is a list of segments split at '*'; a pattern with n stars has n + 1 of them
+        int segments = 1;
+        for (const char *c = pattern; *c; c++) {
+            segments += *c == '*';
+        }
+        matcher->segments = malloc(segments * sizeof(GlobSegment));
+        if (matcher->segments == NULL) {
+            perror("Failed to allocate memory for glob segments");
+            exit(EXIT_FAILURE);
+        }
+        const char *start = pattern;
+        for (int j = 0; j < segments; j++) {
+            GlobSegment *segment = &matcher->segments[j];
+            const char *star = strchr(start, '*');
+            segment->text = start;
+            segment->length = star ? (size_t) (star - start) : strlen(start);
+            segment->anyChar = false;
+            segment->firstLiteral = -1;
+            segment->lastLiteral = -1;
+            for (size_t k = 0; k < segment->length; k++) {
+                if (start[k] == '?') {
+                    segment->anyChar = true;
+                } else {
+                    if (segment->firstLiteral < 0) {
+                        segment->firstLiteral = (int) k;
+                    }
+                    segment->lastLiteral = (int) k;
+                }
+            }
+            matcher->minLength += segment->length;
+            start = star ? star + 1 : start + segment->length;
         }
+        matcher->segments_count = segments;
+        matcher->pattern = pattern;
+        matcher->prefixLength = strcspn(pattern, "*?");
     }
-    strcat(regexPattern, ")"); // Close the parentheses
-    // Compile the constructed regex pattern
-    regex_t regex;
-    const int ret = regcomp(&regex, regexPattern, REG_EXTENDED | REG_NOSUB);
-    free(regexPattern); // Free the combined regex pattern after compiling
-    if (ret != 0) {
-        fprintf(stderr, "Failed to compile regex pattern.\n");
-        return 0; // Return false on compilation failure
+    arguments->matchers = matchers;
+    arguments->matchers_count = count;
+    // Several patterns are scanned for together, so a node is read once however many there are
+    if (count > 1) {
+        arguments->automaton = build_pattern_automaton(matchers, count);
     }
-    // Execute regex match
-    const int match = regexec(&regex, str, 0, NULL, 0) == 0;
-    // Free resources used by the regex engine
-    regfree(&regex);
-    return match;
 }
 
-bool match_by_name(const char *name, char **names) {
-    return matches_pattern(name, names, 1);
+void free_query_matchers(Arguments *arguments) {
+    free_pattern_automaton(arguments->automaton);
+    arguments->automaton = NULL;
+    for (int i = 0; i < arguments->matchers_count; i++) {
+        free(arguments->matchers[i].segments);
+    }
+    free(arguments->matchers);
+    arguments->matchers = NULL;
+    arguments->matchers_count = 0;
 }
 
-bool match_by_path(const char *path, char **paths) {
-    return matches_pattern(path, paths, 1);
+bool plan_prefix_scan(Arguments *arguments, const IndexHeader *header) {
+    if (arguments->matchers == NULL || header->layout != INDEX_LAYOUT_TREE) {
+        return false;
+    }
+    // The tree has to be ordered by the field the patterns are matched against
+    const IndexKey matched = arguments->names != NULL ? INDEX_KEY_NAME : INDEX_KEY_PATH;
+    if (header->key != matched) {
+        return false;
+    }
+    // A pattern that starts with a wildcard can match anywhere in the order
+    for (int i = 0; i < arguments->matchers_count; i++) {
+        if (arguments->matchers[i].prefixLength == 0) {
+            return false;
+        }
+    }
+    arguments->prefix_scan = true;
+    return true;
 }
 
-bool match_by_hash(const char *hash, char **hashes) {
-    if (hash == NULL || hashes == NULL || hashes[0] == NULL) {
-        return false;
+/**
+ * On a tree ordered by strcmp, the keys starting with a prefix P form one run: the left subtree of a node
+ * (keys <= key) can reach it when key >= P, and the right subtree (keys >= key) when key < P or key starts
+ * with P. A subtree is searched when it can reach the run of at least one pattern.
+ */
+static void prefix_scan_bounds(const Arguments *arguments, const char *key, bool *searchLeft, bool *searchRight) {
+    *searchLeft = false;
+    *searchRight = false;
+    for (int i = 0; i < arguments->matchers_count && !(*searchLeft && *searchRight); i++) {
+        const QueryMatcher *matcher = &arguments->matchers[i];
+        const int order = strncmp(key, matcher->pattern, matcher->prefixLength);
+        *searchLeft |= order >= 0;
+        *searchRight |= order <= 0;
     }
-    if (strcmp(hash, hashes[0]) == 0) {
-        return true;
+}
+
+static int compare_size_ranges(const void *a, const void *b) {
+    const SizeRange *x = a, *y = b;
+    return (x->lower > y->lower) - (x->lower < y->lower);
+}
+
+void normalize_size_ranges(Arguments *arguments) {
+    if (arguments->size < 0 && arguments->size_ranges_count == 0) {
+        return;
+    }
+    arguments->size_filtered = true;
+    if (arguments->size_ranges_count == 0) {
+        arguments->size_ranges = malloc(sizeof(SizeRange));
+        if (arguments->size_ranges == NULL) {
+            perror("Failed to allocate memory for size ranges");
+            exit(EXIT_FAILURE);
+        }
+        arguments->size_ranges[0] = (SizeRange) {0, SIZE_MAX};
+        arguments->size_ranges_count = 1;
+    }
+    // Sorted by their lower bound, overlapping and touching ranges become one
+    SizeRange *ranges = arguments->size_ranges;
+    qsort(ranges, arguments->size_ranges_count, sizeof(SizeRange), compare_size_ranges);
+    int merged = 0;
+    for (int i = 1; i < arguments->size_ranges_count; i++) {
+        if (ranges[merged].upper == SIZE_MAX || ranges[i].lower <= ranges[merged].upper + 1) {
+            if (ranges[i].upper > ranges[merged].upper) {
+                ranges[merged].upper = ranges[i].upper;
+            }
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    arguments->size_ranges_count = merged + 1;
+    // -s <size> keeps only that size, if the ranges let it through
+    if (arguments->size >= 0) {
+        const size_t size = (size_t) arguments->size;
+        const bool kept = size_in_ranges(arguments, size);
+        arguments->size_ranges[0] = (SizeRange) {size, size};
+        arguments->size_ranges_count = kept;
     }
-    return false;
 }
 
-bool match_by_size(const char *size, char **sizes) {
-    if (size == NULL || sizes == NULL || sizes[0] == NULL) {
-        return false;
+bool size_in_ranges(const Arguments *arguments, const size_t size) {
+    if (!arguments->size_filtered) {
+        return true;
     }
-    char *endptr1;
-    errno = 0;
-    const size_t size_value = strtoul(size, &endptr1, 10);
-    if (errno != 0 || *endptr1 != '\0') {
-        return false;
+    // The last range that starts at or below size is the only one that can hold it
+    int low = 0, high = arguments->size_ranges_count;
+    while (low < high) {
+        const int mid = low + (high - low) / 2;
+        if (arguments->size_ranges[mid].lower <= size) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
-    char *endptr2;
-    errno = 0;
-    const size_t sizes_value = strtoul(sizes[0], &endptr2, 10);
-    if (errno != 0 || *endptr2 != '\0') {
+    return low > 0 && size <= arguments->size_ranges[low - 1].upper;
+}
+
+bool plan_size_scan(Arguments *arguments, const IndexHeader *header) {
+    if (!arguments->size_filtered || !is_size_tree(header)) {
         return false;
     }
-    return size_value == sizes_value;
+    arguments->size_scan = true;
+    return true;
+}
+
+/**
+ * On a tree ordered by size, the left subtree of a node only holds sizes up to the node's and the right
+ * subtree sizes from it on. Each side keeps the ranges it can still reach, a window of the sorted list, and
+ * is skipped once none is left, so gaps between ranges are pruned as well as the ends.
+ */
+static void size_scan_split(const size_t size, SearchArgs *left, SearchArgs *right) {
+    Arguments *below = &left->arguments;
+    while (below->size_ranges_count > 0 && below->size_ranges[below->size_ranges_count - 1].lower > size) {
+        below->size_ranges_count--;
+    }
+    Arguments *above = &right->arguments;
+    while (above->size_ranges_count > 0 && above->size_ranges[0].upper < size) {
+        above->size_ranges++;
+        above->size_ranges_count--;
+    }
+    left->root = below->size_ranges_count > 0 ? left->root : NULL;
+    right->root = above->size_ranges_count > 0 ? right->root : NULL;
 }
 
-void size_to_string(const size_t size, char *buffer, const size_t buffer_size) {
-    snprintf(buffer, buffer_size, "%zu", size);
+// Print a match and count it; the search threads share the counter
+static void report_match(const FileInfo *info, long long *totalCount) {
+    pthread_mutex_lock(&results_mutex);
+    print_node_info(info);
+    (*totalCount)++;
+    pthread_mutex_unlock(&results_mutex);
 }
 
-void search_tree(Node *root, const Arguments arguments, bool (*match_function)(const char *, char **),
-                 MapResults *results, long long *totalCount) {
+void search_tree(const PackedNode *root, const Arguments arguments, MapResults *results, long long *totalCount) {
     if (root == NULL) {
         return;
     }
-
-    if (should_insert(&arguments, root->key.type) &&
-        ((arguments.size_lower_bound == 0 || arguments.size_lower_bound > 0 && root->key.size >= arguments.
-          size_lower_bound) &&
-         (arguments.size_upper_bound == 0 || arguments.size_upper_bound > 0 && root->key.size <= arguments.
-          size_upper_bound) ||
-         (arguments.size_lower_bound <= root->key.size && root->key.size <= arguments.size_upper_bound))) {
-        if (arguments.names != NULL) {
-            for (int i = 0; i < arguments.names_count; ++i) {
-                if (match_function(root->key.name, &arguments.names[i])) {
-                    if (arguments.names_count > 1) {
-                        map_results_add_node(results, root, arguments.names[i]);
-                    } else {
-                        print_node_info(root);
-                        (*totalCount)++;
-                    }
-                    break;
-                }
-            }
-        } else if (arguments.paths != NULL) {
-            for (int i = 0; i < arguments.paths_count; ++i) {
-                if (match_function(root->key.path, &arguments.paths[i])) {
-                    if (arguments.paths_count > 1) {
-                        map_results_add_node(results, root, arguments.paths[i]);
-                    } else {
-                        print_node_info(root);
-                        (*totalCount)++;
-                    }
-                    break;
+    FileInfo key;
+    packed_file_info(root, &key);
+
+    if (should_insert(&arguments, key.type) && size_in_ranges(&arguments, key.size)) {
+        if (arguments.matchers != NULL) {
+            // Names are matched for -n, paths for -p, by the patterns compiled before the search
+            const char *subject = arguments.names != NULL ? key.name : key.path;
+            const size_t subjectLength = root->pathLength - (arguments.names != NULL ? root->nameOffset : 0);
+            const int matched = query_first_match(&arguments, subject, subjectLength);
+            if (matched >= 0) {
+                if (arguments.matchers_count > 1) {
+                    map_results_add_to_bucket(results, matched, root, arguments.matchers[matched].pattern);
+                } else {
+                    report_match(&key, totalCount);
                 }
             }
         }
         else if (arguments.hashes != NULL) {
             for (int i = 0; i < arguments.hashes_count; ++i) {
-                if (match_function(root->key.hash, &arguments.hashes[i])) {
+                if (key.hash == arguments.hash_values[i]) {
                     if (arguments.hashes_count > 1) {
                         map_results_add_node(results, root, arguments.hashes[i]);
                     } else {
-                        print_node_info(root);
-                        (*totalCount)++;
+                        report_match(&key, totalCount);
                     }
                     break;
                 }
             }
         }
         else if (arguments.hash != NULL) {
-            char *temp_array[] = {arguments.hash, NULL};
-            if (match_function(root->key.hash, temp_array)) {
-                print_node_info(root);
-                (*totalCount)++;
-            }
-        } else if (arguments.size >= 0) {
-            char current_node_size_str[20];
-            size_to_string(root->key.size, current_node_size_str, sizeof(current_node_size_str));
-            char *temp_array[] = {arguments.size_str, NULL};
-            if (match_function(current_node_size_str, temp_array)) {
-                print_node_info(root);
-                (*totalCount)++;
+            if (key.hash == arguments.hash_value) {
+                report_match(&key, totalCount);
             }
-        } else if (arguments.size == -2) {
-            print_node_info(root);
-            (*totalCount)++;
+        } else if (arguments.size >= 0 || arguments.size == -2) {
+            // The size itself was checked against the ranges above
+            report_match(&key, totalCount);
         }
     }
     // Prepare threading arguments
     pthread_t leftThread, rightThread;
-    SearchArgs leftArgs = {root->left, arguments, results, match_function, totalCount};
-    SearchArgs rightArgs = {root->right, arguments, results, match_function, totalCount};
+    SearchArgs leftArgs = {packed_left(root, arguments.records), arguments, results, totalCount};
+    SearchArgs rightArgs = {packed_right(root, arguments.records), arguments, results, totalCount};
+    // Only the subtrees that can hold a match are searched
+    if (arguments.prefix_scan) {
+        bool searchLeft, searchRight;
+        prefix_scan_bounds(&arguments, arguments.names != NULL ? key.name : key.path, &searchLeft, &searchRight);
+        leftArgs.root = searchLeft ? leftArgs.root : NULL;
+        rightArgs.root = searchRight ? rightArgs.root : NULL;
+    }
+    if (arguments.size_scan) {
+        size_scan_split(key.size, &leftArgs, &rightArgs);
+    }
+    const PackedNode *left = leftArgs.root;
+    const PackedNode *right = rightArgs.root;
 
     int create_left_thread = 0, create_right_thread = 0;
 
     // Check and increment the global thread counter
     pthread_mutex_lock(&thread_counter_mutex);
-    if (active_threads < MAX_THREADS) {
+    if (left != NULL && active_threads < MAX_THREADS) {
         active_threads++;
         create_left_thread = 1;
     }
-    if (active_threads < MAX_THREADS) {
+    if (right != NULL && active_threads < MAX_THREADS) {
         active_threads++;
         create_right_thread = 1;
     }
@@ -372,13 +708,13 @@ void search_tree(Node *root, const Arguments arguments, bool (*match_function)(c
     if (create_left_thread) {
         pthread_create(&leftThread, NULL, search_tree_thread, &leftArgs);
     } else {
-        search_tree(root->left, arguments, match_function, results, totalCount);
+        search_tree(left, leftArgs.arguments, results, totalCount);
     }
     // Create or execute the right subtree search
     if (create_right_thread) {
         pthread_create(&rightThread, NULL, search_tree_thread, &rightArgs);
     } else {
-        search_tree(root->right, arguments, match_function, results, totalCount);
+        search_tree(right, rightArgs.arguments, results, totalCount);
     }
     // Join threads if they were created
     if (create_left_thread) {
@@ -397,8 +733,7 @@ void search_tree(Node *root, const Arguments arguments, bool (*match_function)(c
 
 void *search_tree_thread(void *args) {
     const SearchArgs *searchArgs = (SearchArgs *) (args);
-    search_tree(searchArgs->root, searchArgs->arguments, searchArgs->match_function, searchArgs->results,
-                searchArgs->totalCount);
+    search_tree(searchArgs->root, searchArgs->arguments, searchArgs->results, searchArgs->totalCount);
     return NULL;
 }
 
@@ -429,15 +764,9 @@ void print_results(const MapResults *results) {
         // Loop through the data array of Nodes in the current entry
         size_t key_node_count = 0; // Counter for the current key's nodes
         for (size_t i = 0; i < entry->data_count; i++) {
-            Node *node = entry->data[i]; // Access each Node pointer
-            printf("%s: %s | %s (%zu) | %s | %s\n",
-                   (strcmp(node->key.type, "T_DIR") == 0)
-                       ? "Dir"
-                       : (strcmp(node->key.type, "T_LINK_DIR") == 0 || strcmp(node->key.type, "T_LINK_FILE") == 0)
-                             ? "Link"
-                             : "File",
-                   node->key.type, getFileSizeAsString((long long) node->key.size), node->key.size, node->key.name,
-                   node->key.path);
+            FileInfo info; // Decode each record in place
+            packed_file_info(entry->data[i], &info);
+            print_node_info(&info);
             key_node_count++; // Increment the count for this key
         }
         printf("----------------------------------\n");
@@ -497,47 +826,37 @@ long parse_size(const char *size_str) {
     return value * multiplier;
 }
 
-bool is_valid_type(const char *type, const char *valid_types[]) {
-    for (int i = 0; valid_types[i] != NULL; i++) {
-        if (strcmp(type, valid_types[i]) == 0) {
-            return true;
-        }
-    }
-    return false;
-}
-
 void *process_lines(void *arg) {
     const ThreadSearchData *data = (ThreadSearchData *)arg;
-    Arguments arguments = {0};
+    Arguments arguments = {.records = data->records};
     long long localCount = 0;
+    // Hashing contexts are not thread-safe, so every thread has its own
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Unable to create hashing context\n");
+        exit(EXIT_FAILURE);
+    }
 
     for (size_t i = data->start; i < data->end; i++) {
         FileInfo key = {0};
-        if (data->lines != NULL && data->lines[i] != NULL) {
-            parseFileData(data->lines[i], &key, data->ctx);
-        } else {
-            fprintf(stderr, "Error: lines[%ld] is NULL\n", i);
-            continue;
-        }
+        parse_line_span(data->lines[i].data, data->lines[i].length, &key, ctx);
 
         // Ensure `FileInfo` contains valid data
-        if (key.name && key.path && key.type && key.hash) {
-            const size_t length = strlen(key.hash);
-
-            arguments.hash = (char *)malloc(length + 1); // +1 for null terminator
-            if (arguments.hash == NULL) {
-                perror("Failed to allocate memory for arguments.hash");
-                exit(EXIT_FAILURE);
-            }
-            memcpy(arguments.hash, key.hash, length);
-            arguments.hash[length] = '\0';
+        if (key.name && key.path) {
+            char hash[HASH_HEX_LENGTH];
+            hash_to_hex(key.hash, hash);
+            arguments.hash = hash;
+            arguments.hash_value = key.hash;
 
             // Call the search tree (assuming root and results are thread-safe)
-            search_tree(data->root, arguments, match_by_hash, NULL, &localCount);
-            free(arguments.hash);
+            search_tree(data->root, arguments, NULL, &localCount);
         }
     }
 
+    // The parsed keys were only needed for the lookups above
+    string_pool_release(string_pool_current());
+    EVP_MD_CTX_free(ctx);
+
     // Update the total count (atomic operation)
     pthread_mutex_lock(data->result_lock);
     *(data->totalCount) += (int)localCount;
@@ -548,20 +867,19 @@ void *process_lines(void *arg) {
     return NULL;
 }
 
-void parallel_file_processing(const char *filename, void *root, const int maxThreads) {
+void parallel_file_processing(const char *filename, const void *root, const char *records, const int maxThreads) {
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    int totalCount;
+    int totalCount = 0;
     // Determine number of cores and calculate threads
     const size_t numCores = sysconf(_SC_NPROCESSORS_ONLN);
     const int numThreads = (int)(numCores / maxThreads) + 1;
     printf("Number of threads: %d\n", numThreads);
 
-    char **lines = NULL;
-    size_t numLines = 0;
+    MappedLines mapped;
 
-    // Read lines from the file
-    if (read_file_lines(filename, &lines, &numLines) != 0) {
+    // Map the file and find its lines
+    if (map_file_lines(filename, &mapped) != 0) {
         fprintf(stderr, "Failed to read lines from '%s'.\n", filename);
         exit(EXIT_FAILURE);
     }
@@ -585,24 +903,17 @@ void parallel_file_processing(const char *filename, void *root, const int maxThr
     pthread_mutex_init(&result_lock, NULL);
 
     // Calculate workload distribution
-    const size_t chunkSize = (numLines + numThreads - 1) / numThreads;
-
-    // Create an OpenSSL hashing context
-    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-    if (ctx == NULL) {
-        fprintf(stderr, "Error: Unable to create hashing context\n");
-        exit(EXIT_FAILURE);
-    }
+    const size_t chunkSize = (mapped.count + numThreads - 1) / numThreads;
 
     // Create threads and assign data to each thread
     for (int i = 0; i < numThreads; i++) {
         threadData[i].start = i * chunkSize;
-        threadData[i].end = (i + 1) * chunkSize < numLines ? (i + 1) * chunkSize : numLines;
-        threadData[i].lines = lines;
+        threadData[i].end = (i + 1) * chunkSize < mapped.count ? (i + 1) * chunkSize : mapped.count;
+        threadData[i].lines = mapped.lines;
         threadData[i].totalCount = &totalCount;
         threadData[i].root = root;
+        threadData[i].records = records;
         threadData[i].result_lock = &result_lock;
-        threadData[i].ctx = ctx;
         threadData[i].thread_id = i;
 
         if (pthread_create(&threads[i], NULL, process_lines, &threadData[i]) != 0) {
@@ -628,7 +939,7 @@ void parallel_file_processing(const char *filename, void *root, const int maxThr
     pthread_mutex_destroy(&result_lock);
     free(threads);
     free(threadData);
-    EVP_MD_CTX_free(ctx);
+    unmap_file_lines(&mapped);
 }
 
 // Function to create a hash table
@@ -657,14 +968,9 @@ HashTable *create_hash_table(size_t size) {
     return hashTable;
 }
 
-// djb2 hash function
-unsigned long hash_function(const char *key, size_t size) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *key++)) {
-        hash = ((hash << 5) + hash) + c; // hash * 33 + c
-    }
-    return hash % size;
+// Record hashes are already uniformly spread, so the bucket is just the remainder
+unsigned long hash_function(const uint64_t key, const size_t size) {
+    return (unsigned long) (key % size);
 }
 
 FileInfo *copyFileInfo(const FileInfo *source) {
@@ -675,13 +981,8 @@ FileInfo *copyFileInfo(const FileInfo *source) {
         perror("Failed to allocate memory for FileInfo");
         return NULL;
     }
-    strncpy(copy->name, source->name, sizeof(copy->name) - 1);
-    copy->name[sizeof(copy->name) - 1] = '\0';
-    strncpy(copy->path, source->path, sizeof(copy->path) - 1);
-    copy->path[sizeof(copy->path) - 1] = '\0';
-    strncpy(copy->type, source->type, sizeof(copy->type) - 1);
-    copy->type[sizeof(copy->type) - 1] = '\0';
-    copy->size = source->size;
+    // The strings stay in the string pool of the loaded tree, only the record itself is copied
+    *copy = *source;
 
     return copy;
 }
@@ -695,7 +996,7 @@ void insert_into_hash_table(HashTable *hashTable, const FileInfo *entry) {
 
     HashTableEntry *current = hashTable->table[index];
     while (current) {
-        if (strcmp(current->key, entry->hash) == 0) {
+        if (current->key == entry->hash) {
             current->count++;
             current->fileInfo = copyFileInfo(entry);
             pthread_mutex_unlock(&hashTable->lock); // Unlock before returning
@@ -711,7 +1012,7 @@ void insert_into_hash_table(HashTable *hashTable, const FileInfo *entry) {
         pthread_mutex_unlock(&hashTable->lock);
         exit(EXIT_FAILURE);
     }
-    newEntry->key = strdup(entry->hash);
+    newEntry->key = entry->hash;
     newEntry->count = 1;
     newEntry->fileInfo = copyFileInfo(entry);
     newEntry->next = hashTable->table[index];
@@ -727,7 +1028,6 @@ void free_hash_table(HashTable *hashTable) {
         while (current) {
             HashTableEntry *toFree = current;
             current = current->next;
-            free(toFree->key);
             free(toFree->fileInfo);
             free(toFree);
         }
@@ -739,27 +1039,29 @@ void free_hash_table(HashTable *hashTable) {
 
 // Struct to pass arguments to threads
 typedef struct ThreadArgs {
-    Node *root;
+    const PackedNode *root;
     HashTable *hashTable;
 } ThreadArgs;
 
 // Recursive function to traverse the tree and insert hashes (with thread limiting)
 void *parallel_traverse_and_insert(void *args) {
     const ThreadDuplicatesArgs *threadArgs = (ThreadDuplicatesArgs *)args;
-    const Node *root = threadArgs->root;
+    const PackedNode *root = threadArgs->root;
     HashTable *hashTable = threadArgs->hashTable;
     Arguments *arguments = threadArgs->arguments;
 
     if (root == NULL) return NULL; // Base case: empty tree/subtree
+    FileInfo key;
+    packed_file_info(root, &key);
 
     // Insert current node's hash into the hash table
-    if (should_insert(arguments, root->key.type)) {
-        insert_into_hash_table(hashTable, &root->key);
+    if (should_insert(arguments, key.type)) {
+        insert_into_hash_table(hashTable, &key);
     }
     // Prepare arguments for left and right subtree threads
     pthread_t leftThread, rightThread;
-    ThreadDuplicatesArgs leftArgs = {root->left, hashTable, arguments};
-    ThreadDuplicatesArgs rightArgs = {root->right, hashTable, arguments};
+    ThreadDuplicatesArgs leftArgs = {packed_left(root, arguments->records), hashTable, arguments};
+    ThreadDuplicatesArgs rightArgs = {packed_right(root, arguments->records), hashTable, arguments};
 
     // Track whether threads are spawned
     bool leftThreadSpawned = false, rightThreadSpawned = false;
@@ -807,7 +1109,7 @@ void *parallel_traverse_and_insert(void *args) {
 }
 
 // Traverse tree in parallel and insert hash values (entry point)
-void traverse_tree_in_parallel(Node *root, HashTable *hashTable, Arguments *arguments) {
+void traverse_tree_in_parallel(const PackedNode *root, HashTable *hashTable, Arguments *arguments) {
     if (root == NULL) return; // If the tree is empty, there's nothing to process
 
     ThreadDuplicatesArgs args = {root, hashTable, arguments};
@@ -824,6 +1126,7 @@ void print_help() {
     printf("                     - Lower bound: '10M-'\n");
     printf("                     - Upper bound: '10M'\n");
     printf("                     - Range: '10M-100M'.\n");
+    printf("                     - Several ranges, separated by commas: '1k-4k,1G'.\n");
     printf("  -p <paths>         Multiple paths to be provided (space-separated, stop with the next argument starting with '-').\n");
     printf("  -t <type>          Specify the type. Allowed values are:\n");
     printf("                     T_DIR, T_TEXT, T_BINARY, T_IMAGE, T_JSON, T_AUDIO, T_FILM, T_COMPRESSED, T_YAML, T_EXE,\n");
@@ -831,13 +1134,20 @@ void print_help() {
     printf("                     T_PDF, T_JAR, T_HTML, T_XML, T_XHTML, T_MATLAB, T_FORTRAN, T_SCIENCE, T_CPP, T_TS, T_DOC,\n");
     printf("                     T_CALC, T_LATEX, T_SQL, T_PRESENTATION, T_DATA, T_LIBRARY, T_OBJECT, T_CSV, T_CSS, T_LINK_DIR,\n");
     printf("                     T_LINK_FILE, T_FILE\n");
+    printf("  --count            Count the files matching -s/--size (and -t) instead of listing them (size trees).\n");
+    printf("  --sum              Total size of the files matching -s/--size (and -t) instead of listing them (size trees).\n");
+    printf("  --rank <size>      Number of files smaller than the given size, e.g. 1G (size trees).\n");
+    printf("                     --rank, --select and --percentile count all files and cannot be used with -t.\n");
+    printf("  --select <k>       Show the k-th file in tree order, starting from 1.\n");
+    printf("  --percentile <p>   Show the file at the p-th percentile in tree order, e.g. 99 or 99.9.\n");
+    printf("  --verify           Check the whole index against its checksum before running the query.\n");
     printf("  -h <hash> <file> <filesize>\n");
     printf("                     Compute the hash of the specified file. Requires filename and filesize.\n");
     printf("  --help             Display this help message and exit.\n");
     exit(EXIT_SUCCESS); // Terminate the program after displaying the help message
 }
 
-void detect_duplicates(Node *root, Arguments *arguments) {
+void detect_duplicates(const PackedNode *root, Arguments *arguments) {
     // Create the hash table
     HashTable *hashTable = create_hash_table(INITIAL_HASH_TABLE_SIZE);
     // Traverse the tree and populate the hash table
@@ -845,11 +1155,13 @@ void detect_duplicates(Node *root, Arguments *arguments) {
     // Print the results
     printf("----------------------------------\n");
     printf("Duplicates:\n");
+    char hash[HASH_HEX_LENGTH];
     for (size_t i = 0; i < hashTable->size; i++) {
         const HashTableEntry *current = hashTable->table[i];
         while (current) {
             if (current->count > 1) {
-                printf("Hash: %s, Count: %d %s|%s|%s|%ld\n", current->key, current->count, current->fileInfo->type, current->fileInfo->name, current->fileInfo->path, current->fileInfo->size);
+                hash_to_hex(current->key, hash);
+                printf("Hash: %s, Count: %d %s|%s|%s|%ld\n", hash, current->count, FILE_TYPES[current->fileInfo->type], current->fileInfo->name, current->fileInfo->path, current->fileInfo->size);
             }
             current = current->next;
         }
@@ -859,6 +1171,348 @@ void detect_duplicates(Node *root, Arguments *arguments) {
     free_hash_table(hashTable);
 }
 
+// Trees built by rbt_create --size (or rbt_size_create) record their key in the header
+bool is_size_tree(const IndexHeader *header) {
+    return header->layout == INDEX_LAYOUT_TREE && header->key == INDEX_KEY_SIZE;
+}
+
+bool has_order_statistics_query(const Arguments *arguments) {
+    return arguments->count || arguments->sum || arguments->rank >= 0 || arguments->select > 0 || arguments->percentile >= 0;
+}
+
+static int compare_by_size(const FileInfo *a, const FileInfo *b) {
+    return (a->size > b->size) - (a->size < b->size);
+}
+
+// The size ranges selected by -s <size> or --size <ranges>, the whole size axis when neither is given
+static int size_query_ranges(const Arguments *arguments, const SizeRange **ranges) {
+    static const SizeRange everything = {0, SIZE_MAX};
+    if (!arguments->size_filtered) {
+        *ranges = &everything;
+        return 1;
+    }
+    *ranges = arguments->size_ranges;
+    return arguments->size_ranges_count;
+}
+
+// Count and add up the records of a size tree within [lower, upper] whose type passes -t, skipping subtrees outside the range
+static void size_range_by_type(const PackedNode *node, const size_t lower, const size_t upper,
+                               const Arguments *arguments, uint64_t *count, uint64_t *sum) {
+    while (node) {
+        if (node->size < lower) {
+            node = packed_right(node, arguments->records);
+        } else if (node->size > upper) {
+            node = packed_left(node, arguments->records);
+        } else {
+            FileInfo key;
+            packed_file_info(node, &key);
+            if (should_insert(arguments, key.type)) {
+                (*count)++;
+                *sum += key.size;
+            }
+            size_range_by_type(packed_left(node, arguments->records), lower, upper, arguments, count, sum);
+            node = packed_right(node, arguments->records);
+        }
+    }
+}
+
+// Number and total size of the files in one size range that pass -t
+static void size_range_totals(const PackedNode *root, const SizeRange *range, const Arguments *arguments,
+                              uint64_t *count, uint64_t *sum) {
+    *count = 0;
+    *sum = 0;
+    if (arguments->types_mask) {
+        size_range_by_type(root, range->lower, range->upper, arguments, count, sum);
+        return;
+    }
+    const FileInfo lowerKey = {.size = range->lower};
+    const FileInfo upperKey = {.size = range->upper};
+    uint64_t sumBelow, sumUpTo;
+    *count = packed_tree_rank(root, arguments->records, &upperKey, compare_by_size, true, &sumUpTo) -
+             packed_tree_rank(root, arguments->records, &lowerKey, compare_by_size, false, &sumBelow);
+    *sum = sumUpTo - sumBelow;
+}
+
+// Positions are counted over the whole index, so a -t filter cannot apply to --rank, --select or --percentile
+static void reject_type_filter(const Arguments *arguments) {
+    const char *option = arguments->rank >= 0 ? "--rank"
+                         : arguments->select > 0 ? "--select"
+                         : arguments->percentile >= 0 ? "--percentile" : NULL;
+    if (option && arguments->types_mask) {
+        fprintf(stderr, "Error: %s counts every file in the index and cannot be combined with -t\n", option);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void require_size_tree(const IndexHeader *header, const Arguments *arguments, const char *option) {
+    if (!is_size_tree(header)) {
+        fprintf(stderr, "Error: %s needs a tree ordered by size (rbt_size_*), %s is ordered by %s\n", option,
+                arguments->mem_filename, index_key_name((IndexKey) header->key));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double percent_of(const uint64_t part, const uint64_t total) {
+    return total ? 100.0 * (double) part / (double) total : 0.0;
+}
+
+/**
+ * Answers --count, --sum, --rank, --select and --percentile from the subtree counts and sums stored in
+ * every record, so each query walks one or two root-to-leaf paths instead of the whole tree. Range totals
+ * with a -t filter still have to look at the matching records, but skip everything outside the size range.
+ */
+void order_statistics_query(const IndexHeader *header, const Arguments *arguments) {
+    const PackedNode *root = index_tree_root(header);
+    const uint64_t total = packed_count(root);
+    reject_type_filter(arguments);
+    printf("----------------------------------\n");
+    const SizeRange *ranges;
+    const int rangeCount = size_query_ranges(arguments, &ranges);
+    if (arguments->count) {
+        require_size_tree(header, arguments, "--count");
+        for (int i = 0; i < rangeCount; i++) {
+            uint64_t count, sum;
+            size_range_totals(root, &ranges[i], arguments, &count, &sum);
+            printf("Files in size range %zu-%zu: %llu of %llu (%.2f%%)\n", ranges[i].lower, ranges[i].upper,
+                   (unsigned long long) count, (unsigned long long) total, percent_of(count, total));
+        }
+    }
+    if (arguments->sum) {
+        require_size_tree(header, arguments, "--sum");
+        for (int i = 0; i < rangeCount; i++) {
+            uint64_t count, sum;
+            size_range_totals(root, &ranges[i], arguments, &count, &sum);
+            char *sumStr = getFileSizeAsString((long long) sum);
+            printf("Total size of files in size range %zu-%zu: %s (%llu bytes) in %llu files, %.2f%% of %llu bytes\n",
+                   ranges[i].lower, ranges[i].upper, sumStr, (unsigned long long) sum, (unsigned long long) count,
+                   percent_of(sum, packed_sum(root)), (unsigned long long) packed_sum(root));
+            free(sumStr);
+        }
+    }
+    if (arguments->rank >= 0) {
+        require_size_tree(header, arguments, "--rank");
+        const FileInfo key = {.size = (size_t) arguments->rank};
+        const uint64_t smaller = packed_tree_rank(root, arguments->records, &key, compare_by_size, false, NULL);
+        printf("Files smaller than %ld bytes: %llu of %llu (%.2f%%)\n", arguments->rank,
+               (unsigned long long) smaller, (unsigned long long) total, percent_of(smaller, total));
+    }
+    if (arguments->select > 0) {
+        const PackedNode *node = packed_tree_select(root, arguments->records, arguments->select - 1);
+        if (node == NULL) {
+            printf("No file at position %zu, the tree holds %llu\n", arguments->select, (unsigned long long) total);
+        } else {
+            FileInfo key;
+            packed_file_info(node, &key);
+            printf("File %zu of %llu:\n", arguments->select, (unsigned long long) total);
+            print_node_info(&key);
+        }
+    }
+    if (arguments->percentile >= 0 && total > 0) {
+        // Nearest-rank percentile: the smallest file with at least p% of the files at or below it
+        const double exact = arguments->percentile / 100.0 * (double) total;
+        uint64_t position = (uint64_t) exact;
+        position += (double) position < exact || position == 0;
+        FileInfo key;
+        packed_file_info(packed_tree_select(root, arguments->records, position - 1), &key);
+        printf("Percentile %.2f (file %llu of %llu):\n", arguments->percentile, (unsigned long long) position,
+               (unsigned long long) total);
+        print_node_info(&key);
+    }
+}
+
+/**
+ * Position in key order of the first record whose key is not below x, or the record count if there is
+ * none. The loop has no data-dependent branch: each level picks a child with arithmetic, and the keys
+ * three levels below are prefetched since they share one cache line.
+ */
+static uint64_t eytzinger_lower_bound(const char *base, const IndexHeader *header, const uint64_t x) {
+    const uint64_t *keys = (const uint64_t *) (base + header->keys);
+    const uint64_t n = header->count;
+    uint64_t k = 1;
+    while (k <= n) {
+        __builtin_prefetch(keys + 8 * k);
+        k = 2 * k + (keys[k] < x);
+    }
+    // Undo the trailing right turns plus the final left turn to land on the answer
+    k >>= __builtin_ffsll((long long) ~k);
+    return k ? ((const uint64_t *) (base + header->ranks))[k] : n;
+}
+
+// Position in key order just past the last record whose key is not above x
+static uint64_t eytzinger_upper_bound(const char *base, const IndexHeader *header, const uint64_t x) {
+    return x == UINT64_MAX ? header->count : eytzinger_lower_bound(base, header, x + 1);
+}
+
+// Print (or just tally) the records [first, last) whose type passes -t
+static void eytzinger_report_range(const char *base, const IndexHeader *header, const uint64_t first,
+                                   const uint64_t last, const Arguments *arguments, const bool print,
+                                   MapResults *results, const char *resultKey, uint64_t *count, uint64_t *sum) {
+    for (uint64_t i = first; i < last; i++) {
+        const PackedNode *record = eytzinger_record(base, header, i);
+        FileInfo key;
+        packed_file_info(record, &key);
+        if (!should_insert(arguments, key.type)) {
+            continue;
+        }
+        if (results) {
+            map_results_add_node(results, record, resultKey);
+        } else if (print) {
+            print_node_info(&key);
+        }
+        (*count)++;
+        *sum += key.size;
+    }
+}
+
+// --duplicates over a hash index: equal hashes are adjacent, so every run of them is one duplicate group
+static void eytzinger_duplicates(const char *base, const IndexHeader *header, const Arguments *arguments) {
+    int numDuplicates = 0;
+    int sumCounts = 0;
+    printf("----------------------------------\n");
+    printf("Duplicates:\n");
+    for (uint64_t first = 0; first < header->count;) {
+        FileInfo key;
+        packed_file_info(eytzinger_record(base, header, first), &key);
+        const uint64_t value = eytzinger_key(&key, INDEX_KEY_HASH);
+        uint64_t last = first;
+        int count = 0;
+        FileInfo sample = {0};
+        for (; last < header->count; last++) {
+            FileInfo other;
+            packed_file_info(eytzinger_record(base, header, last), &other);
+            if (eytzinger_key(&other, INDEX_KEY_HASH) != value) {
+                break;
+            }
+            if (should_insert(arguments, other.type)) {
+                sample = other;
+                count++;
+            }
+        }
+        if (count > 1) {
+            char hash[HASH_HEX_LENGTH];
+            hash_to_hex(sample.hash, hash);
+            printf("Hash: %s, Count: %d %s|%s|%s|%ld\n", hash, count, FILE_TYPES[sample.type], sample.name, sample.path,
+                   sample.size);
+            numDuplicates++;
+            sumCounts += count;
+        }
+        first = last;
+    }
+    printf("----------------------------------\n");
+    printf("Found duplicated elements: %d\nSum of all duplicated element counts: %d\n", numDuplicates, sumCounts);
+}
+
+static void unsupported_by_eytzinger(const char *option) {
+    fprintf(stderr, "Error: %s is not supported by this Eytzinger index, rebuild it without --eytzinger.\n", option);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Answers a query from an Eytzinger index: every lookup is a lower-bound search over the key table
+ * followed by a scan of the matching records, which are stored in key order.
+ */
+void eytzinger_query(const char *base, const IndexHeader *header, const Arguments *arguments) {
+    if (arguments->names || arguments->paths) {
+        unsupported_by_eytzinger(arguments->names ? "-n" : "-p");
+    }
+    if (arguments->filename) {
+        unsupported_by_eytzinger("--file");
+    }
+    uint64_t count = 0, sum = 0;
+    if (header->key == INDEX_KEY_HASH) {
+        if (arguments->duplicates) {
+            eytzinger_duplicates(base, header, arguments);
+            return;
+        }
+        if (arguments->hash == NULL && arguments->hashes == NULL) {
+            unsupported_by_eytzinger("A size query");
+        }
+        MapResults results = {0};
+        const bool grouped = arguments->hashes_count > 1;
+        const int hashCount = arguments->hash ? 1 : arguments->hashes_count;
+        for (int i = 0; i < hashCount; i++) {
+            const char *hash = arguments->hash ? arguments->hash : arguments->hashes[i];
+            const uint64_t value = arguments->hash ? arguments->hash_value : arguments->hash_values[i];
+            eytzinger_report_range(base, header, eytzinger_lower_bound(base, header, value),
+                                   eytzinger_upper_bound(base, header, value), arguments, true,
+                                   grouped ? &results : NULL, hash, &count, &sum);
+        }
+        if (grouped) {
+            print_results(&results);
+            cleanup_map_results(&results);
+            return;
+        }
+    } else {
+        if (arguments->hash || arguments->hashes || arguments->duplicates) {
+            unsupported_by_eytzinger(arguments->duplicates ? "--duplicates" : "A hash query");
+        }
+        const uint64_t total = header->count;
+        reject_type_filter(arguments);
+        // Each statistic is answered on its own, as on a tree; the records are only listed when none was asked for
+        const bool statistics = has_order_statistics_query(arguments);
+        if (statistics) {
+            printf("----------------------------------\n");
+        }
+        if (!statistics || arguments->count || arguments->sum) {
+            // The ranges are disjoint and sorted, so the records come out in size order without repeats
+            const SizeRange *ranges;
+            const int rangeCount = size_query_ranges(arguments, &ranges);
+            for (int i = 0; i < rangeCount; i++) {
+                uint64_t rangeFiles = 0, rangeSum = 0;
+                eytzinger_report_range(base, header, eytzinger_lower_bound(base, header, ranges[i].lower),
+                                       eytzinger_upper_bound(base, header, ranges[i].upper), arguments, !statistics,
+                                       NULL, NULL, &rangeFiles, &rangeSum);
+                count += rangeFiles;
+                sum += rangeSum;
+                if (arguments->count) {
+                    printf("Files in size range %zu-%zu: %llu of %llu (%.2f%%)\n", ranges[i].lower, ranges[i].upper,
+                           (unsigned long long) rangeFiles, (unsigned long long) total,
+                           percent_of(rangeFiles, total));
+                }
+                if (arguments->sum) {
+                    char *sumStr = getFileSizeAsString((long long) rangeSum);
+                    printf("Total size of files in size range %zu-%zu: %s (%llu bytes) in %llu files\n",
+                           ranges[i].lower, ranges[i].upper, sumStr, (unsigned long long) rangeSum,
+                           (unsigned long long) rangeFiles);
+                    free(sumStr);
+                }
+            }
+        }
+        if (arguments->rank >= 0) {
+            const uint64_t smaller = eytzinger_lower_bound(base, header, (uint64_t) arguments->rank);
+            printf("Files smaller than %ld bytes: %llu of %llu (%.2f%%)\n", arguments->rank,
+                   (unsigned long long) smaller, (unsigned long long) total, percent_of(smaller, total));
+        }
+        // Records are in key order, so selecting by position is a plain index
+        if (arguments->select > 0) {
+            if (arguments->select > total) {
+                printf("No file at position %zu, the index holds %llu\n", arguments->select,
+                       (unsigned long long) total);
+            } else {
+                FileInfo key;
+                packed_file_info(eytzinger_record(base, header, arguments->select - 1), &key);
+                printf("File %zu of %llu:\n", arguments->select, (unsigned long long) total);
+                print_node_info(&key);
+            }
+        }
+        if (arguments->percentile >= 0 && total > 0) {
+            const double exact = arguments->percentile / 100.0 * (double) total;
+            uint64_t position = (uint64_t) exact;
+            position += (double) position < exact || position == 0;
+            FileInfo key;
+            packed_file_info(eytzinger_record(base, header, position - 1), &key);
+            printf("Percentile %.2f (file %llu of %llu):\n", arguments->percentile, (unsigned long long) position,
+                   (unsigned long long) total);
+            print_node_info(&key);
+        }
+        if (statistics) {
+            return;
+        }
+    }
+    printf("----------------------------------\n");
+    printf("\nTotal nodes found: %llu\n", (unsigned long long) count);
+}
+
 // Function to compute the number of duplicated hashes and their sum
 void compute_duplicates_summary(HashTable *hashTable) {
     if (!hashTable) {
@@ -887,22 +1541,24 @@ void compute_duplicates_summary(HashTable *hashTable) {
 }
 
 void free_arguments(Arguments *args) {
+    free_query_matchers(args);
+    free(args->size_ranges);
+    args->size_ranges = NULL;
+    args->size_ranges_count = 0;
     if (args->names) {
         free(args->names);
-        *args->names = NULL;
+        args->names = NULL;
     }
     if (args->paths) {
         free(args->paths);
-        *args->paths = NULL;
+        args->paths = NULL;
     }
     if (args->hashes) {
         free(args->hashes);
-        *args->hashes = NULL;
-    }
-    if (args->types) {
-        free(args->types);
-        *args->types = NULL;
+        args->hashes = NULL;
     }
+    free(args->hash_values);
+    args->hash_values = NULL;
     if (args->filename) {
         free(args->filename);
         args->filename = NULL;
@@ -921,23 +1577,7 @@ void free_arguments(Arguments *args) {
     }
 }
 
-bool should_insert(const Arguments *args, const char *type) {
-    // 1. Insert if root.type is in args.types
-    if (args->types != NULL) {
-        for (int i = 0; i < args->types_count; i++) {
-            if (strcmp(args->types[i], type) == 0) {
-                return true; // Type is allowed
-            }
-        }
-    }
-    // 2. Insert if args.types is NULL (no restrictions)
-    if (args->types == NULL) {
-        return true;
-    }
-    // 3. Insert if there is only one element in args.types, and it equals T_FILE
-    if (args->types_count == 1 && strcmp(args->types[0], "T_FILE") == 0 && strcmp(type, "T_DIR") != 0) {
-        return true;
-    }
-
-    return false; // All conditions failed
+bool should_insert(const Arguments *args, const FileType type) {
+    // No -t means no restriction; otherwise the type's bit has to be set
+    return args->types_mask == 0 || (args->types_mask >> type & 1) != 0;
 }
\ No newline at end of file
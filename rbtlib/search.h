@@ -9,29 +9,84 @@ typedef struct {
     size_t capacity;
 } NodeArray;
 
+// An inclusive range of file sizes
+typedef struct SizeRange {
+    size_t lower;
+    size_t upper;
+} SizeRange;
+
+// A run of a glob between two '*', matched byte for byte except for '?'
+typedef struct GlobSegment {
+    const char *text;  // Points into the pattern
+    size_t length;
+    bool anyChar;      // The segment contains '?'
+    int firstLiteral;  // Offsets of the first and last byte that is not '?', -1 when there is none
+    int lastLiteral;
+} GlobSegment;
+
+// A -n or -p pattern compiled once before the search; the search threads only read it
+typedef struct QueryMatcher {
+    const char *pattern;    // The pattern as given on the command line, the key of its results
+    GlobSegment *segments;  // The pattern split at '*': the first is anchored at the start, the last at the end
+    int segments_count;
+    size_t minLength;       // Bytes a match needs at least, the pattern without its stars
+    size_t prefixLength;    // Length of the literal text before the first wildcard
+} QueryMatcher;
+
+// Aho-Corasick automaton over the longest literal run (the anchor) of every pattern
+typedef struct PatternAutomaton {
+    int *transitions;     // states_count x classes_count, the next state for every state and byte class
+    int *outputs;         // First pattern whose anchor ends in the state, -1 when none
+    int *dictionary;      // Nearest state down the failure links that has an output, -1 when none
+    int *next_pattern;    // Next pattern with the same anchor, -1 at the end of the list
+    int *unanchored;      // Patterns without a literal byte, in order; every node is a candidate for them
+    int unanchored_count;
+    int states_count;
+    int classes_count;
+    uint8_t classes[256]; // Byte class of every byte; bytes that are in no anchor share class 0
+} PatternAutomaton;
+
 typedef struct {
     char *mem_filename;
+    const char *records; // First record of the mapped index, the bound every child offset is checked against
     char *filename;
     char **names;
     int names_count;
     char **hashes;
+    uint64_t *hash_values; // hashes parsed from hex, compared as integers
     int hashes_count;
-    char **types;
+    uint64_t types_mask; // Bit (1 << FileType) set for every type given to -t, 0 when -t is absent
     int types_count;
     int size;
-    char *size_str;
-    size_t size_lower_bound;
-    size_t size_upper_bound;
+    SizeRange *size_ranges; // Sizes selected by -s/--size, sorted and disjoint once normalized
+    int size_ranges_count;
+    bool size_filtered;     // -s <size> or --size was given; no ranges then means no size passes
     char **paths;
     int paths_count;
+    QueryMatcher *matchers; // The -n (or else -p) patterns, compiled by compile_query_matchers
+    int matchers_count;
+    PatternAutomaton *automaton; // Built over the matchers when there are several, NULL otherwise
+    bool prefix_scan;  // The tree is ordered by the matched field, only the patterns' prefix runs are searched
+    bool size_scan;    // The tree is ordered by size, only the subtrees that overlap size_ranges are searched
     char *type;
     char *hash;
+    uint64_t hash_value; // hash as an integer
+    const char *hash_name; // File name given to -h, hashed with its size once the index tells how
+    size_t hash_size;
     bool duplicates;
+    bool count;        // Count the files in the size range instead of listing them
+    bool sum;          // Add up the sizes of the files in the size range instead of listing them
+    bool verify;       // Check the index records against their checksum before querying
+    long rank;         // Size whose rank is requested, -1 when not requested
+    size_t select;     // 1-based position of the file to select, 0 when not requested
+    double percentile; // Percentile of the file to select, negative when not requested
 } Arguments;
 
+_Static_assert(FILE_TYPES_COUNT <= 64, "Arguments.types_mask needs a bit per file type");
+
 typedef struct NodeHashmapEntry {
     char *key;            // The key for the hashmap (e.g., filename, or any criteria)
-    Node **data;          // The value (an array of Node pointers)
+    const PackedNode **data; // The value (an array of records in the mapped tree)
     size_t data_count;    // Number of nodes in the array
     size_t capacity;      // Capacity of the array for dynamic resizing
     UT_hash_handle hh;    // Handle for uthash
@@ -40,24 +95,25 @@ typedef struct NodeHashmapEntry {
 typedef struct {
     NodeHashmapEntry *entry; // Hashmap of NodeHashmapEntry structs
     size_t size;               // Total number of keys in the hashmap
+    NodeHashmapEntry **buckets; // Entry of every pattern by its index, NULL until its first match
+    size_t buckets_count;
 } MapResults;
 
 typedef struct SearchArgs {
-    Node *root;                // The root of the tree to search
+    const PackedNode *root;    // The root of the tree to search
     Arguments arguments;       // Arguments provided to the search
     MapResults *results;      // The hashmap to store search results
-    bool (*match_function)(const char *, char **);
     long long *totalCount;
 } SearchArgs;
 
 typedef struct {
     size_t start;
     size_t end;
-    char **lines;
+    const LineSpan *lines;
     int *totalCount;
-    void *root;
+    const void *root;
+    const char *records;
     pthread_mutex_t *result_lock;
-    void *ctx;
     int thread_id;
 } ThreadSearchData;
 
@@ -65,7 +121,7 @@ typedef struct {
 #define LOAD_FACTOR_THRESHOLD 0.75
 
 typedef struct HashTableEntry {
-    char *key; // The hash string (e.g., from FileInfo)
+    uint64_t key; // The record hash
     int count;
     FileInfo *fileInfo;
     struct HashTableEntry *next;
@@ -79,7 +135,7 @@ typedef struct HashTable {
 
 // Struct to pass arguments to threads
 typedef struct ThreadDuplicatesArgs {
-    Node *root;
+    const PackedNode *root;
     HashTable *hashTable;
     Arguments *arguments;
 } ThreadDuplicatesArgs;
@@ -90,13 +146,27 @@ void search_tree_by_filename_and_type(Node *root, Arguments arguments, MapResult
 
 int initialize_threads();
 
-Node *load_tree_from_shared_memory(const char *name);
+const char *map_shared_memory_index(const char *name, size_t *length);
+
+const PackedNode *load_tree_from_shared_memory(const char *name);
+
+void eytzinger_query(const char *base, const IndexHeader *header, const Arguments *arguments);
+
+void compile_query_matchers(Arguments *arguments);
+
+bool query_matcher_matches(const QueryMatcher *matcher, const char *str, size_t length);
+
+bool plan_prefix_scan(Arguments *arguments, const IndexHeader *header);
 
-int matches_pattern(const char *str, char **names, int names_count);
+int query_first_match(const Arguments *arguments, const char *str, size_t length);
 
-char *convert_glob_to_regex(const char *namePattern);
+void free_query_matchers(Arguments *arguments);
 
-void map_results_add_node(MapResults *mapResults, Node *node, const char *key);
+void map_results_add_node(MapResults *mapResults, const PackedNode *node, const char *key);
+
+void map_results_reserve_buckets(MapResults *mapResults, size_t count);
+
+void map_results_add_to_bucket(MapResults *mapResults, size_t bucket, const PackedNode *node, const char *key);
 
 void node_array_free(NodeArray *array);
 
@@ -104,40 +174,42 @@ void cleanup_map_results(MapResults *mapResults);
 
 void print_results(const MapResults *results);
 
-void search_tree(Node *root, Arguments arguments, bool (*match_function)(const char *, char **), MapResults *results, long long *totalCount);
+void print_node_info(const FileInfo *info);
 
-bool match_by_name(const char *name, char **names);
-
-bool match_by_path(const char *path, char **paths);
+void search_tree(const PackedNode *root, Arguments arguments, MapResults *results, long long *totalCount);
 
 long parse_size(const char *size_str);
 
-bool match_by_hash(const char *hash, char **hashes);
-
-void size_to_string(size_t size, char *buffer, size_t buffer_size);
+void normalize_size_ranges(Arguments *arguments);
 
-bool match_by_size(const char *size, char **sizes);
+bool size_in_ranges(const Arguments *arguments, size_t size);
 
-bool is_valid_type(const char *type, const char *valid_types[]);
+bool plan_size_scan(Arguments *arguments, const IndexHeader *header);
 
 void *process_lines(void *arg);
 
-void parallel_file_processing(const char *filename, void *root, int maxThreads);
+void parallel_file_processing(const char *filename, const void *root, const char *records, int maxThreads);
 
 HashTable *create_hash_table(size_t size);
 
-void traverse_tree_in_parallel(Node *root, HashTable *hashTable, Arguments *arguments);
+void traverse_tree_in_parallel(const PackedNode *root, HashTable *hashTable, Arguments *arguments);
 
 void free_hash_table(HashTable *hashTable);
 
 void print_help();
 
-void detect_duplicates(Node *root, Arguments *arguments);
+void detect_duplicates(const PackedNode *root, Arguments *arguments);
+
+bool is_size_tree(const IndexHeader *header);
+
+bool has_order_statistics_query(const Arguments *arguments);
+
+void order_statistics_query(const IndexHeader *header, const Arguments *arguments);
 
 void compute_duplicates_summary(HashTable *hashTable);
 
 void free_arguments(Arguments *args);
 
-bool should_insert(const Arguments *args, const char *type);
+bool should_insert(const Arguments *args, FileType type);
 
 #endif //RBTSEARCH_H
@@ -2,6 +2,7 @@
 #define LCONSTS_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 // Constants
@@ -15,6 +16,40 @@
 #define NEW "w"
 #define SEP "|"
 
+#ifndef FILE_TYPES_H
+#define FILE_TYPES_H
+
+/**
+ * Every file type the crawler can assign, in the order of their numeric ids. The ids are stored in the
+ * index files, so new types go at the end. The names (e.g. "T_DIR") only appear in listings and on the
+ * command line; FILE_TYPES[] maps an id back to its name.
+ */
+#define FILE_TYPE_LIST(X) \
+    X(T_DIR) X(T_TEXT) X(T_BINARY) X(T_IMAGE) X(T_JSON) X(T_AUDIO) X(T_FILM) \
+    X(T_COMPRESSED) X(T_YAML) X(T_EXE) X(T_C) X(T_PYTHON) X(T_JS) \
+    X(T_JAVA) X(T_LOG) X(T_PACKAGE) X(T_CLASS) X(T_TEMPLATE) X(T_PHP) X(T_MATHEMATICA) \
+    X(T_PDF) X(T_JAR) X(T_HTML) X(T_XML) X(T_XHTML) X(T_MATLAB) X(T_FORTRAN) X(T_SCIENCE) X(T_CPP) \
+    X(T_TS) X(T_DOC) X(T_CALC) X(T_LATEX) X(T_SQL) X(T_PRESENTATION) X(T_DATA) X(T_LIBRARY) X(T_OBJECT) \
+    X(T_CSV) X(T_CSS) X(T_LINK_DIR) X(T_LINK_FILE)
+
+#define FILE_TYPE_ENUM_ENTRY(name) name,
+enum {
+    FILE_TYPE_LIST(FILE_TYPE_ENUM_ENTRY)
+    FILE_TYPES_COUNT
+};
+#undef FILE_TYPE_ENUM_ENTRY
+
+// A file type id is stored in a single byte
+typedef uint8_t FileType;
+
+// Returned by file_type_from_name for names that are not in FILE_TYPE_LIST
+#define FILE_TYPE_INVALID ((FileType) UINT8_MAX)
+
+// Declare the constant array as extern
+extern const char *FILE_TYPES[];
+
+#endif // FILE_TYPES_H
+
 // Structures
 typedef struct FileEntry {
     char path[MAX_LINE_LENGTH];
@@ -24,7 +59,7 @@ typedef struct FileEntry {
     int isHidden;
     char linkTarget[MAX_LINE_LENGTH];
     size_t childrenCount;
-    char type[128];
+    FileType type;
 } FileEntry;
 
 typedef struct TaskQueue {
@@ -64,13 +99,3 @@ typedef struct FileStatistics {
 
 
 #endif // LCONSTS_H
-
-#ifndef FILE_TYPES_H
-#define FILE_TYPES_H
-
-// Declare the constant array as extern
-extern const char* FILE_TYPES[];
-// Define its size as a macro for array iteration
-#define FILE_TYPES_COUNT 43
-
-#endif // FILE_TYPES_H
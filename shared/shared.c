@@ -1,14 +1,11 @@
 #include "shared.h"
 #include "lconsts.h"
 
-const char *_FILE_TYPES[] = {
-    "T_DIR", "T_TEXT", "T_BINARY", "T_IMAGE", "T_JSON", "T_AUDIO", "T_FILM",
-    "T_COMPRESSED", "T_YAML", "T_EXE", "T_C", "T_PYTHON", "T_JS",
-    "T_JAVA", "T_LOG", "T_PACKAGE", "T_CLASS", "T_TEMPLATE", "T_PHP", "T_MATHEMATICA",
-    "T_PDF", "T_JAR", "T_HTML", "T_XML", "T_XHTML", "T_MATLAB", "T_FORTRAN", "T_SCIENCE", "T_CPP",
-    "T_TS", "T_DOC", "T_CALC", "T_LATEX", "T_SQL", "T_PRESENTATION", "T_DATA", "T_LIBRARY", "T_OBJECT",
-    "T_CSV", "T_CSS", "T_LINK_DIR", "T_LINK_FILE"
+#define FILE_TYPE_NAME_ENTRY(name) #name,
+const char *FILE_TYPES[] = {
+    FILE_TYPE_LIST(FILE_TYPE_NAME_ENTRY)
 };
+#undef FILE_TYPE_NAME_ENTRY
 
 /**
  * Helper function to check if a string is a valid size_t (non-negative integer).
@@ -28,14 +25,24 @@ int is_size_t(const char *str) {
     return 1; // Entire string is numeric
 }
 
-// Function to check if a value belongs to _FILE_TYPES
-bool is_valid_file_type(const char *type) {
+/**
+ * Map a file type name (e.g. "T_DIR") to its id. The name does not need to be NUL-terminated.
+ * @param name: The type name.
+ * @param length: The length of the name in bytes.
+ * @return The type id, or FILE_TYPE_INVALID for unknown names.
+ */
+FileType file_type_from_name(const char *name, const size_t length) {
     for (int i = 0; i < FILE_TYPES_COUNT; i++) {
-        if (strcmp(_FILE_TYPES[i], type) == 0) {
-            return true;
+        if (strlen(FILE_TYPES[i]) == length && memcmp(FILE_TYPES[i], name, length) == 0) {
+            return (FileType) i;
         }
     }
-    return false;
+    return FILE_TYPE_INVALID;
+}
+
+// Function to check if a value belongs to FILE_TYPES
+bool is_valid_file_type(const char *type) {
+    return file_type_from_name(type, strlen(type)) != FILE_TYPE_INVALID;
 }
 
 /**
@@ -90,7 +97,7 @@ int process_file(const char *filename) {
             continue; // Go to the next line
         }
 
-        // Validate the 3rd column against _FILE_TYPES
+        // Validate the 3rd column against FILE_TYPES
         if (!is_valid_file_type(columns[2])) {
             fprintf(stderr, "Error: Invalid file type in the third column at line %d. Row content: \"%s\"\n",
                     lineNumber, lineCopy);
@@ -23,6 +23,8 @@ int process_file(const char *filename);
 
 void check_input_files(char **inputFileNames, char ***rootDirectories, int *rootCount);
 
+FileType file_type_from_name(const char *name, size_t length);
+
 bool is_valid_file_type(const char *type);
 
 int is_size_t(const char *str);